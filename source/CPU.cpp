@@ -1,5 +1,7 @@
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <type_traits>
 
 #include <boost/format.hpp>
 
@@ -11,62 +13,387 @@
 #define VECTOR_RESET 0xfffc
 #define VECTOR_IRQ   0xfffe
 
-// Minimum number of CPU cycles needed to execute each Opcode
-static const uint8_t instructionCycles[] = {
-	7, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6,
-	2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
-	6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6,
-	2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
-	6, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6,
-	2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
-	6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 5, 4, 6, 6,
-	2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
-	2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
-	2, 6, 2, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5,
-	2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
-	2, 5, 2, 5, 4, 4, 4, 4, 2, 4, 2, 4, 4, 4, 4, 4,
-	2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
-	2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
-	2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
-	2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+/**
+ * Decoding information for a single opcode.
+ *
+ * All of the metadata needed to decode an instruction is kept together so
+ * that a single lookup covers the whole decode.
+ */
+struct InstructionInfo
+{
+	const char*          name;   /**< Instruction mnemonic. */
+	uint8_t              cycles; /**< Minimum number of CPU cycles needed to execute the instruction. */
+	MemoryAddressingMode mode;   /**< Addressing mode used by the instruction. */
+	bool                 writes; /**< Whether the instruction writes to memory, including the stack. */
 };
 
-// Instruction Names for each Opcode
-static const char* instructionNames[] = {
-	"BRK", "ORA", "KIL", "SLO", "NOP", "ORA", "ASL", "SLO",
-	"PHP", "ORA", "ASL", "ANC", "NOP", "ORA", "ASL", "SLO",
-	"BPL", "ORA", "KIL", "SLO", "NOP", "ORA", "ASL", "SLO",
-	"CLC", "ORA", "NOP", "SLO", "NOP", "ORA", "ASL", "SLO",
-	"JSR", "AND", "KIL", "RLA", "BIT", "AND", "ROL", "RLA",
-	"PLP", "AND", "ROL", "ANC", "BIT", "AND", "ROL", "RLA",
-	"BMI", "AND", "KIL", "RLA", "NOP", "AND", "ROL", "RLA",
-	"SEC", "AND", "NOP", "RLA", "NOP", "AND", "ROL", "RLA",
-	"RTI", "EOR", "KIL", "SRE", "NOP", "EOR", "LSR", "SRE",
-	"PHA", "EOR", "LSR", "ALR", "JMP", "EOR", "LSR", "SRE",
-	"BVC", "EOR", "KIL", "SRE", "NOP", "EOR", "LSR", "SRE",
-	"CLI", "EOR", "NOP", "SRE", "NOP", "EOR", "LSR", "SRE",
-	"RTS", "ADC", "KIL", "RRA", "NOP", "ADC", "ROR", "RRA",
-	"PLA", "ADC", "ROR", "ARR", "JMP", "ADC", "ROR", "RRA",
-	"BVS", "ADC", "KIL", "RRA", "NOP", "ADC", "ROR", "RRA",
-	"SEI", "ADC", "NOP", "RRA", "NOP", "ADC", "ROR", "RRA",
-	"NOP", "STA", "NOP", "SAX", "STY", "STA", "STX", "SAX",
-	"DEY", "NOP", "TXA", "XAA", "STY", "STA", "STX", "SAX",
-	"BCC", "STA", "KIL", "AHX", "STY", "STA", "STX", "SAX",
-	"TYA", "STA", "TXS", "TAS", "SHY", "STA", "SHX", "AHX",
-	"LDY", "LDA", "LDX", "LAX", "LDY", "LDA", "LDX", "LAX",
-	"TAY", "LDA", "TAX", "LAX", "LDY", "LDA", "LDX", "LAX",
-	"BCS", "LDA", "KIL", "LAX", "LDY", "LDA", "LDX", "LAX",
-	"CLV", "LDA", "TSX", "LAS", "LDY", "LDA", "LDX", "LAX",
-	"CPY", "CMP", "NOP", "DCP", "CPY", "CMP", "DEC", "DCP",
-	"INY", "CMP", "DEX", "AXS", "CPY", "CMP", "DEC", "DCP",
-	"BNE", "CMP", "KIL", "DCP", "NOP", "CMP", "DEC", "DCP",
-	"CLD", "CMP", "NOP", "DCP", "NOP", "CMP", "DEC", "DCP",
-	"CPX", "SBC", "NOP", "ISC", "CPX", "SBC", "INC", "ISC",
-	"INX", "SBC", "NOP", "SBC", "CPX", "SBC", "INC", "ISC",
-	"BEQ", "SBC", "KIL", "ISC", "NOP", "SBC", "INC", "ISC",
-	"SED", "SBC", "NOP", "ISC", "NOP", "SBC", "INC", "ISC",
+// Decoding information for each opcode
+static const InstructionInfo instructionTable[0x100] = {
+	{ "BRK", 7, MEM_IMPLIED,               true  }, // 00
+	{ "ORA", 6, MEM_PRE_INDEXED_INDIRECT,  false }, // 01
+	{ "KIL", 2, MEM_IMPLIED,               false }, // 02
+	{ "SLO", 8, MEM_PRE_INDEXED_INDIRECT,  true  }, // 03
+	{ "NOP", 3, MEM_ZERO_PAGE_ABSOLUTE,    false }, // 04
+	{ "ORA", 3, MEM_ZERO_PAGE_ABSOLUTE,    false }, // 05
+	{ "ASL", 5, MEM_ZERO_PAGE_ABSOLUTE,    true  }, // 06
+	{ "SLO", 5, MEM_ZERO_PAGE_ABSOLUTE,    true  }, // 07
+	{ "PHP", 3, MEM_IMPLIED,               true  }, // 08
+	{ "ORA", 2, MEM_IMMEDIATE,             false }, // 09
+	{ "ASL", 2, MEM_ACCUMULATOR,           false }, // 0A
+	{ "ANC", 2, MEM_IMMEDIATE,             false }, // 0B
+	{ "NOP", 4, MEM_ABSOLUTE,              false }, // 0C
+	{ "ORA", 4, MEM_ABSOLUTE,              false }, // 0D
+	{ "ASL", 6, MEM_ABSOLUTE,              true  }, // 0E
+	{ "SLO", 6, MEM_ABSOLUTE,              true  }, // 0F
+	{ "BPL", 2, MEM_RELATIVE,              false }, // 10
+	{ "ORA", 5, MEM_POST_INDEXED_INDIRECT, false }, // 11
+	{ "KIL", 2, MEM_IMPLIED,               false }, // 12
+	{ "SLO", 8, MEM_POST_INDEXED_INDIRECT, true  }, // 13
+	{ "NOP", 4, MEM_ZERO_PAGE_INDEXED_X,   false }, // 14
+	{ "ORA", 4, MEM_ZERO_PAGE_INDEXED_X,   false }, // 15
+	{ "ASL", 6, MEM_ZERO_PAGE_INDEXED_X,   true  }, // 16
+	{ "SLO", 6, MEM_ZERO_PAGE_INDEXED_X,   true  }, // 17
+	{ "CLC", 2, MEM_IMPLIED,               false }, // 18
+	{ "ORA", 4, MEM_INDEXED_Y,             false }, // 19
+	{ "NOP", 2, MEM_IMPLIED,               false }, // 1A
+	{ "SLO", 7, MEM_INDEXED_Y,             true  }, // 1B
+	{ "NOP", 4, MEM_INDEXED_X,             false }, // 1C
+	{ "ORA", 4, MEM_INDEXED_X,             false }, // 1D
+	{ "ASL", 7, MEM_INDEXED_X,             true  }, // 1E
+	{ "SLO", 7, MEM_INDEXED_X,             true  }, // 1F
+	{ "JSR", 6, MEM_ABSOLUTE,              true  }, // 20
+	{ "AND", 6, MEM_PRE_INDEXED_INDIRECT,  false }, // 21
+	{ "KIL", 2, MEM_IMPLIED,               false }, // 22
+	{ "RLA", 8, MEM_PRE_INDEXED_INDIRECT,  true  }, // 23
+	{ "BIT", 3, MEM_ZERO_PAGE_ABSOLUTE,    false }, // 24
+	{ "AND", 3, MEM_ZERO_PAGE_ABSOLUTE,    false }, // 25
+	{ "ROL", 5, MEM_ZERO_PAGE_ABSOLUTE,    true  }, // 26
+	{ "RLA", 5, MEM_ZERO_PAGE_ABSOLUTE,    true  }, // 27
+	{ "PLP", 4, MEM_IMPLIED,               false }, // 28
+	{ "AND", 2, MEM_IMMEDIATE,             false }, // 29
+	{ "ROL", 2, MEM_ACCUMULATOR,           false }, // 2A
+	{ "ANC", 2, MEM_IMMEDIATE,             false }, // 2B
+	{ "BIT", 4, MEM_ABSOLUTE,              false }, // 2C
+	{ "AND", 4, MEM_ABSOLUTE,              false }, // 2D
+	{ "ROL", 6, MEM_ABSOLUTE,              true  }, // 2E
+	{ "RLA", 6, MEM_ABSOLUTE,              true  }, // 2F
+	{ "BMI", 2, MEM_RELATIVE,              false }, // 30
+	{ "AND", 5, MEM_POST_INDEXED_INDIRECT, false }, // 31
+	{ "KIL", 2, MEM_IMPLIED,               false }, // 32
+	{ "RLA", 8, MEM_POST_INDEXED_INDIRECT, true  }, // 33
+	{ "NOP", 4, MEM_ZERO_PAGE_INDEXED_X,   false }, // 34
+	{ "AND", 4, MEM_ZERO_PAGE_INDEXED_X,   false }, // 35
+	{ "ROL", 6, MEM_ZERO_PAGE_INDEXED_X,   true  }, // 36
+	{ "RLA", 6, MEM_ZERO_PAGE_INDEXED_X,   true  }, // 37
+	{ "SEC", 2, MEM_IMPLIED,               false }, // 38
+	{ "AND", 4, MEM_INDEXED_Y,             false }, // 39
+	{ "NOP", 2, MEM_IMPLIED,               false }, // 3A
+	{ "RLA", 7, MEM_INDEXED_Y,             true  }, // 3B
+	{ "NOP", 4, MEM_INDEXED_X,             false }, // 3C
+	{ "AND", 4, MEM_INDEXED_X,             false }, // 3D
+	{ "ROL", 7, MEM_INDEXED_X,             true  }, // 3E
+	{ "RLA", 7, MEM_INDEXED_X,             true  }, // 3F
+	{ "RTI", 6, MEM_IMPLIED,               false }, // 40
+	{ "EOR", 6, MEM_PRE_INDEXED_INDIRECT,  false }, // 41
+	{ "KIL", 2, MEM_IMPLIED,               false }, // 42
+	{ "SRE", 8, MEM_PRE_INDEXED_INDIRECT,  true  }, // 43
+	{ "NOP", 3, MEM_ZERO_PAGE_ABSOLUTE,    false }, // 44
+	{ "EOR", 3, MEM_ZERO_PAGE_ABSOLUTE,    false }, // 45
+	{ "LSR", 5, MEM_ZERO_PAGE_ABSOLUTE,    true  }, // 46
+	{ "SRE", 5, MEM_ZERO_PAGE_ABSOLUTE,    true  }, // 47
+	{ "PHA", 3, MEM_IMPLIED,               true  }, // 48
+	{ "EOR", 2, MEM_IMMEDIATE,             false }, // 49
+	{ "LSR", 2, MEM_ACCUMULATOR,           false }, // 4A
+	{ "ALR", 2, MEM_IMMEDIATE,             false }, // 4B
+	{ "JMP", 3, MEM_ABSOLUTE,              false }, // 4C
+	{ "EOR", 4, MEM_ABSOLUTE,              false }, // 4D
+	{ "LSR", 6, MEM_ABSOLUTE,              true  }, // 4E
+	{ "SRE", 6, MEM_ABSOLUTE,              true  }, // 4F
+	{ "BVC", 2, MEM_RELATIVE,              false }, // 50
+	{ "EOR", 5, MEM_POST_INDEXED_INDIRECT, false }, // 51
+	{ "KIL", 2, MEM_IMPLIED,               false }, // 52
+	{ "SRE", 8, MEM_POST_INDEXED_INDIRECT, true  }, // 53
+	{ "NOP", 4, MEM_ZERO_PAGE_INDEXED_X,   false }, // 54
+	{ "EOR", 4, MEM_ZERO_PAGE_INDEXED_X,   false }, // 55
+	{ "LSR", 6, MEM_ZERO_PAGE_INDEXED_X,   true  }, // 56
+	{ "SRE", 6, MEM_ZERO_PAGE_INDEXED_X,   true  }, // 57
+	{ "CLI", 2, MEM_IMPLIED,               false }, // 58
+	{ "EOR", 4, MEM_INDEXED_Y,             false }, // 59
+	{ "NOP", 2, MEM_IMPLIED,               false }, // 5A
+	{ "SRE", 7, MEM_INDEXED_Y,             true  }, // 5B
+	{ "NOP", 4, MEM_INDEXED_X,             false }, // 5C
+	{ "EOR", 4, MEM_INDEXED_X,             false }, // 5D
+	{ "LSR", 7, MEM_INDEXED_X,             true  }, // 5E
+	{ "SRE", 7, MEM_INDEXED_X,             true  }, // 5F
+	{ "RTS", 6, MEM_IMPLIED,               false }, // 60
+	{ "ADC", 6, MEM_PRE_INDEXED_INDIRECT,  false }, // 61
+	{ "KIL", 2, MEM_IMPLIED,               false }, // 62
+	{ "RRA", 8, MEM_PRE_INDEXED_INDIRECT,  true  }, // 63
+	{ "NOP", 3, MEM_ZERO_PAGE_ABSOLUTE,    false }, // 64
+	{ "ADC", 3, MEM_ZERO_PAGE_ABSOLUTE,    false }, // 65
+	{ "ROR", 5, MEM_ZERO_PAGE_ABSOLUTE,    true  }, // 66
+	{ "RRA", 5, MEM_ZERO_PAGE_ABSOLUTE,    true  }, // 67
+	{ "PLA", 4, MEM_IMPLIED,               false }, // 68
+	{ "ADC", 2, MEM_IMMEDIATE,             false }, // 69
+	{ "ROR", 2, MEM_ACCUMULATOR,           false }, // 6A
+	{ "ARR", 2, MEM_IMMEDIATE,             false }, // 6B
+	{ "JMP", 5, MEM_INDIRECT,              false }, // 6C
+	{ "ADC", 4, MEM_ABSOLUTE,              false }, // 6D
+	{ "ROR", 6, MEM_ABSOLUTE,              true  }, // 6E
+	{ "RRA", 6, MEM_ABSOLUTE,              true  }, // 6F
+	{ "BVS", 2, MEM_RELATIVE,              false }, // 70
+	{ "ADC", 5, MEM_POST_INDEXED_INDIRECT, false }, // 71
+	{ "KIL", 2, MEM_IMPLIED,               false }, // 72
+	{ "RRA", 8, MEM_POST_INDEXED_INDIRECT, true  }, // 73
+	{ "NOP", 4, MEM_ZERO_PAGE_INDEXED_X,   false }, // 74
+	{ "ADC", 4, MEM_ZERO_PAGE_INDEXED_X,   false }, // 75
+	{ "ROR", 6, MEM_ZERO_PAGE_INDEXED_X,   true  }, // 76
+	{ "RRA", 6, MEM_ZERO_PAGE_INDEXED_X,   true  }, // 77
+	{ "SEI", 2, MEM_IMPLIED,               false }, // 78
+	{ "ADC", 4, MEM_INDEXED_Y,             false }, // 79
+	{ "NOP", 2, MEM_IMPLIED,               false }, // 7A
+	{ "RRA", 7, MEM_INDEXED_Y,             true  }, // 7B
+	{ "NOP", 4, MEM_INDEXED_X,             false }, // 7C
+	{ "ADC", 4, MEM_INDEXED_X,             false }, // 7D
+	{ "ROR", 7, MEM_INDEXED_X,             true  }, // 7E
+	{ "RRA", 7, MEM_INDEXED_X,             true  }, // 7F
+	{ "NOP", 2, MEM_IMMEDIATE,             false }, // 80
+	{ "STA", 6, MEM_PRE_INDEXED_INDIRECT,  true  }, // 81
+	{ "NOP", 2, MEM_IMMEDIATE,             false }, // 82
+	{ "SAX", 6, MEM_PRE_INDEXED_INDIRECT,  true  }, // 83
+	{ "STY", 3, MEM_ZERO_PAGE_ABSOLUTE,    true  }, // 84
+	{ "STA", 3, MEM_ZERO_PAGE_ABSOLUTE,    true  }, // 85
+	{ "STX", 3, MEM_ZERO_PAGE_ABSOLUTE,    true  }, // 86
+	{ "SAX", 3, MEM_ZERO_PAGE_ABSOLUTE,    true  }, // 87
+	{ "DEY", 2, MEM_IMPLIED,               false }, // 88
+	{ "NOP", 2, MEM_IMMEDIATE,             false }, // 89
+	{ "TXA", 2, MEM_IMPLIED,               false }, // 8A
+	{ "XAA", 2, MEM_IMMEDIATE,             false }, // 8B
+	{ "STY", 4, MEM_ABSOLUTE,              true  }, // 8C
+	{ "STA", 4, MEM_ABSOLUTE,              true  }, // 8D
+	{ "STX", 4, MEM_ABSOLUTE,              true  }, // 8E
+	{ "SAX", 4, MEM_ABSOLUTE,              true  }, // 8F
+	{ "BCC", 2, MEM_RELATIVE,              false }, // 90
+	{ "STA", 6, MEM_POST_INDEXED_INDIRECT, true  }, // 91
+	{ "KIL", 2, MEM_IMPLIED,               false }, // 92
+	{ "AHX", 6, MEM_POST_INDEXED_INDIRECT, true  }, // 93
+	{ "STY", 4, MEM_ZERO_PAGE_INDEXED_X,   true  }, // 94
+	{ "STA", 4, MEM_ZERO_PAGE_INDEXED_X,   true  }, // 95
+	{ "STX", 4, MEM_ZERO_PAGE_INDEXED_Y,   true  }, // 96
+	{ "SAX", 4, MEM_ZERO_PAGE_INDEXED_Y,   true  }, // 97
+	{ "TYA", 2, MEM_IMPLIED,               false }, // 98
+	{ "STA", 5, MEM_INDEXED_Y,             true  }, // 99
+	{ "TXS", 2, MEM_IMPLIED,               false }, // 9A
+	{ "TAS", 5, MEM_INDEXED_Y,             true  }, // 9B
+	{ "SHY", 5, MEM_INDEXED_X,             true  }, // 9C
+	{ "STA", 5, MEM_INDEXED_X,             true  }, // 9D
+	{ "SHX", 5, MEM_INDEXED_Y,             true  }, // 9E
+	{ "AHX", 5, MEM_INDEXED_Y,             true  }, // 9F
+	{ "LDY", 2, MEM_IMMEDIATE,             false }, // A0
+	{ "LDA", 6, MEM_PRE_INDEXED_INDIRECT,  false }, // A1
+	{ "LDX", 2, MEM_IMMEDIATE,             false }, // A2
+	{ "LAX", 6, MEM_PRE_INDEXED_INDIRECT,  false }, // A3
+	{ "LDY", 3, MEM_ZERO_PAGE_ABSOLUTE,    false }, // A4
+	{ "LDA", 3, MEM_ZERO_PAGE_ABSOLUTE,    false }, // A5
+	{ "LDX", 3, MEM_ZERO_PAGE_ABSOLUTE,    false }, // A6
+	{ "LAX", 3, MEM_ZERO_PAGE_ABSOLUTE,    false }, // A7
+	{ "TAY", 2, MEM_IMPLIED,               false }, // A8
+	{ "LDA", 2, MEM_IMMEDIATE,             false }, // A9
+	{ "TAX", 2, MEM_IMPLIED,               false }, // AA
+	{ "LAX", 2, MEM_IMMEDIATE,             false }, // AB
+	{ "LDY", 4, MEM_ABSOLUTE,              false }, // AC
+	{ "LDA", 4, MEM_ABSOLUTE,              false }, // AD
+	{ "LDX", 4, MEM_ABSOLUTE,              false }, // AE
+	{ "LAX", 4, MEM_ABSOLUTE,              false }, // AF
+	{ "BCS", 2, MEM_RELATIVE,              false }, // B0
+	{ "LDA", 5, MEM_POST_INDEXED_INDIRECT, false }, // B1
+	{ "KIL", 2, MEM_IMPLIED,               false }, // B2
+	{ "LAX", 5, MEM_POST_INDEXED_INDIRECT, false }, // B3
+	{ "LDY", 4, MEM_ZERO_PAGE_INDEXED_X,   false }, // B4
+	{ "LDA", 4, MEM_ZERO_PAGE_INDEXED_X,   false }, // B5
+	{ "LDX", 4, MEM_ZERO_PAGE_INDEXED_Y,   false }, // B6
+	{ "LAX", 4, MEM_ZERO_PAGE_INDEXED_Y,   false }, // B7
+	{ "CLV", 2, MEM_IMPLIED,               false }, // B8
+	{ "LDA", 4, MEM_INDEXED_Y,             false }, // B9
+	{ "TSX", 2, MEM_IMPLIED,               false }, // BA
+	{ "LAS", 4, MEM_INDEXED_Y,             false }, // BB
+	{ "LDY", 4, MEM_INDEXED_X,             false }, // BC
+	{ "LDA", 4, MEM_INDEXED_X,             false }, // BD
+	{ "LDX", 4, MEM_INDEXED_Y,             false }, // BE
+	{ "LAX", 4, MEM_INDEXED_Y,             false }, // BF
+	{ "CPY", 2, MEM_IMMEDIATE,             false }, // C0
+	{ "CMP", 6, MEM_PRE_INDEXED_INDIRECT,  false }, // C1
+	{ "NOP", 2, MEM_IMMEDIATE,             false }, // C2
+	{ "DCP", 8, MEM_PRE_INDEXED_INDIRECT,  true  }, // C3
+	{ "CPY", 3, MEM_ZERO_PAGE_ABSOLUTE,    false }, // C4
+	{ "CMP", 3, MEM_ZERO_PAGE_ABSOLUTE,    false }, // C5
+	{ "DEC", 5, MEM_ZERO_PAGE_ABSOLUTE,    true  }, // C6
+	{ "DCP", 5, MEM_ZERO_PAGE_ABSOLUTE,    true  }, // C7
+	{ "INY", 2, MEM_IMPLIED,               false }, // C8
+	{ "CMP", 2, MEM_IMMEDIATE,             false }, // C9
+	{ "DEX", 2, MEM_IMPLIED,               false }, // CA
+	{ "AXS", 2, MEM_IMMEDIATE,             false }, // CB
+	{ "CPY", 4, MEM_ABSOLUTE,              false }, // CC
+	{ "CMP", 4, MEM_ABSOLUTE,              false }, // CD
+	{ "DEC", 6, MEM_ABSOLUTE,              true  }, // CE
+	{ "DCP", 6, MEM_ABSOLUTE,              true  }, // CF
+	{ "BNE", 2, MEM_RELATIVE,              false }, // D0
+	{ "CMP", 5, MEM_POST_INDEXED_INDIRECT, false }, // D1
+	{ "KIL", 2, MEM_IMPLIED,               false }, // D2
+	{ "DCP", 8, MEM_POST_INDEXED_INDIRECT, true  }, // D3
+	{ "NOP", 4, MEM_ZERO_PAGE_INDEXED_X,   false }, // D4
+	{ "CMP", 4, MEM_ZERO_PAGE_INDEXED_X,   false }, // D5
+	{ "DEC", 6, MEM_ZERO_PAGE_INDEXED_X,   true  }, // D6
+	{ "DCP", 6, MEM_ZERO_PAGE_INDEXED_X,   true  }, // D7
+	{ "CLD", 2, MEM_IMPLIED,               false }, // D8
+	{ "CMP", 4, MEM_INDEXED_Y,             false }, // D9
+	{ "NOP", 2, MEM_IMPLIED,               false }, // DA
+	{ "DCP", 7, MEM_INDEXED_Y,             true  }, // DB
+	{ "NOP", 4, MEM_INDEXED_X,             false }, // DC
+	{ "CMP", 4, MEM_INDEXED_X,             false }, // DD
+	{ "DEC", 7, MEM_INDEXED_X,             true  }, // DE
+	{ "DCP", 7, MEM_INDEXED_X,             true  }, // DF
+	{ "CPX", 2, MEM_IMMEDIATE,             false }, // E0
+	{ "SBC", 6, MEM_PRE_INDEXED_INDIRECT,  false }, // E1
+	{ "NOP", 2, MEM_IMMEDIATE,             false }, // E2
+	{ "ISC", 8, MEM_PRE_INDEXED_INDIRECT,  true  }, // E3
+	{ "CPX", 3, MEM_ZERO_PAGE_ABSOLUTE,    false }, // E4
+	{ "SBC", 3, MEM_ZERO_PAGE_ABSOLUTE,    false }, // E5
+	{ "INC", 5, MEM_ZERO_PAGE_ABSOLUTE,    true  }, // E6
+	{ "ISC", 5, MEM_ZERO_PAGE_ABSOLUTE,    true  }, // E7
+	{ "INX", 2, MEM_IMPLIED,               false }, // E8
+	{ "SBC", 2, MEM_IMMEDIATE,             false }, // E9
+	{ "NOP", 2, MEM_IMPLIED,               false }, // EA
+	{ "SBC", 2, MEM_IMMEDIATE,             false }, // EB
+	{ "CPX", 4, MEM_ABSOLUTE,              false }, // EC
+	{ "SBC", 4, MEM_ABSOLUTE,              false }, // ED
+	{ "INC", 6, MEM_ABSOLUTE,              true  }, // EE
+	{ "ISC", 6, MEM_ABSOLUTE,              true  }, // EF
+	{ "BEQ", 2, MEM_RELATIVE,              false }, // F0
+	{ "SBC", 5, MEM_POST_INDEXED_INDIRECT, false }, // F1
+	{ "KIL", 2, MEM_IMPLIED,               false }, // F2
+	{ "ISC", 8, MEM_POST_INDEXED_INDIRECT, true  }, // F3
+	{ "NOP", 4, MEM_ZERO_PAGE_INDEXED_X,   false }, // F4
+	{ "SBC", 4, MEM_ZERO_PAGE_INDEXED_X,   false }, // F5
+	{ "INC", 6, MEM_ZERO_PAGE_INDEXED_X,   true  }, // F6
+	{ "ISC", 6, MEM_ZERO_PAGE_INDEXED_X,   true  }, // F7
+	{ "SED", 2, MEM_IMPLIED,               false }, // F8
+	{ "SBC", 4, MEM_INDEXED_Y,             false }, // F9
+	{ "NOP", 2, MEM_IMPLIED,               false }, // FA
+	{ "ISC", 7, MEM_INDEXED_Y,             true  }, // FB
+	{ "NOP", 4, MEM_INDEXED_X,             false }, // FC
+	{ "SBC", 4, MEM_INDEXED_X,             false }, // FD
+	{ "INC", 7, MEM_INDEXED_X,             true  }, // FE
+	{ "ISC", 7, MEM_INDEXED_X,             true  }, // FF
 };
 
+/**
+ * Get the length in bytes of an instruction using an addressing mode.
+ */
+static uint8_t getInstructionLength( MemoryAddressingMode mode )
+{
+	switch( mode )
+	{
+	case MEM_IMPLIED:
+	case MEM_ACCUMULATOR:
+		return 1;
+	case MEM_ABSOLUTE:
+	case MEM_INDEXED_X:
+	case MEM_INDEXED_Y:
+	case MEM_INDIRECT:
+		return 3;
+	default:
+		return 2;
+	}
+}
+
+/**
+ * Check if an instruction ends a translated block.
+ */
+static bool isBlockTerminator( uint8_t opcode )
+{
+	switch( opcode )
+	{
+	case 0x00: // BRK
+	case 0x20: // JSR
+	case 0x40: // RTI
+	case 0x4c: // JMP
+	case 0x60: // RTS
+	case 0x6c: // JMP
+		return true;
+	default:
+		return instructionTable[opcode].mode == MEM_RELATIVE;
+	}
+}
+
+/**
+ * Check if an instruction can be part of a translated block.
+ *
+ * Only instructions that are known to access internal RAM are allowed,
+ * so that blocks never touch I/O registers or the mapper.
+ */
+static bool isTranslatable( uint8_t opcode, uint16_t operand )
+{
+	// JSR and JMP use their operand as a target, not a memory access
+	if( opcode == 0x20 || opcode == 0x4c )
+	{
+		return true;
+	}
+
+	// CLI, PLP and RTI can enable interrupts, and a pending IRQ must be
+	// taken right after them
+	if( opcode == 0x58 || opcode == 0x28 || opcode == 0x40 )
+	{
+		return false;
+	}
+
+	switch( instructionTable[opcode].mode )
+	{
+	case MEM_ABSOLUTE:
+		return operand < 0x2000;
+	case MEM_INDEXED_X:
+	case MEM_INDEXED_Y:
+		return operand + 0xff < 0x2000;
+	case MEM_INDIRECT:
+	case MEM_PRE_INDEXED_INDIRECT:
+	case MEM_POST_INDEXED_INDIRECT:
+		return false;
+	default:
+		return true;
+	}
+}
+
+//*********************************************************************
+// The Registers struct
+//*********************************************************************
+
+uint8_t CPU::Registers::getP() const
+{
+	uint8_t value = p.raw & ~(BIT_1 | BIT_6 | BIT_7);
+	value |= (signResult & BIT_7);
+	value |= ((zeroResult == 0) ? BIT_1 : 0);
+	value |= ((overflowResult & BIT_7) ? BIT_6 : 0);
+	return value;
+}
+
+bool CPU::Registers::operator == ( const Registers& other ) const
+{
+	return a == other.a &&
+		x == other.x &&
+		y == other.y &&
+		s == other.s &&
+		pc.w == other.pc.w &&
+		getP() == other.getP();
+}
+
+void CPU::Registers::setP( uint8_t value )
+{
+	p.raw = value;
+	signResult = value & BIT_7;
+	zeroResult = ((value & BIT_1) ? 0 : 1);
+	overflowResult = (value & BIT_6) << 1;
+}
+
 //*********************************************************************
 // The RegisterAccess template
 //*********************************************************************
@@ -98,7 +425,7 @@ CPU::RegisterAccess<R>& CPU::RegisterAccess<R>::operator = ( uint8_t value )
 		registers.pc.l = value;
 		break;
 	case REGISTER_P:
-		registers.p.raw = value;
+		registers.setP(value);
 		break;
 	}
 
@@ -121,7 +448,7 @@ CPU::RegisterAccess<R>::operator uint8_t()
 	case REGISTER_PC:
 		return registers.pc.l;
 	case REGISTER_P:
-		return registers.p.raw;
+		return registers.getP();
 	}
 }
 
@@ -129,336 +456,653 @@ CPU::RegisterAccess<R>::operator uint8_t()
 // The CPU class
 //*********************************************************************
 
+CPU::OpcodeHandler CPU::opcodeHandlers[0x100];
+
+template <>
+void CPU::fillOpcodeHandlers<0>()
+{
+}
+
+template <int Count>
+void CPU::fillOpcodeHandlers()
+{
+	fillOpcodeHandlers<Count - 1>();
+	opcodeHandlers[Count - 1] = &executeOpcode<Count - 1>;
+}
+
 CPU::CPU( NES& nes ) :
 	nes(nes)
 {
+	fillOpcodeHandlers<0x100>();
+
+	ram = nes.getMemory().getRAM();
+
+	int prgSize = nes.getMemory().getPrgSize();
+	decodeCache = new DecodedInstruction[prgSize];
+	blockCache = new TranslatedBlock*[prgSize];
+	for( int i = 0; i < prgSize; i++ )
+	{
+		decodeCache[i].length = 0;
+		blockCache[i] = nullptr;
+	}
+
+	executionMode = EXECUTION_INTERPRETER;
+	loopStart = false;
+
 	// Reset to the initial power on state
 	powerOn();
+}
 
-	// Initialize the opcode table
-	for( int i = 0; i < 0x100; i++ )
+CPU::~CPU()
+{
+	for( int i = 0; i < nes.getMemory().getPrgSize(); i++ )
 	{
-		opcodes[i] = nullptr;
+		delete blockCache[i];
 	}
+	delete [] blockCache;
+	delete [] decodeCache;
+}
 
-	// ADC
-	opcodes[0x69] = &CPU::opADC<MEM_IMMEDIATE>;
-	opcodes[0x65] = &CPU::opADC<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0x75] = &CPU::opADC<MEM_ZERO_PAGE_INDEXED_X>;
-	opcodes[0x6D] = &CPU::opADC<MEM_ABSOLUTE>;
-	opcodes[0x7D] = &CPU::opADC<MEM_INDEXED_X>;
-	opcodes[0x79] = &CPU::opADC<MEM_INDEXED_Y>;
-	opcodes[0x61] = &CPU::opADC<MEM_PRE_INDEXED_INDIRECT>;
-	opcodes[0x71] = &CPU::opADC<MEM_POST_INDEXED_INDIRECT>;
+void CPU::decode( DecodedInstruction& instruction, uint16_t address )
+{
+	Memory& memory = nes.getMemory();
 
-	// AND
-	opcodes[0x29] = &CPU::opAND<MEM_IMMEDIATE>;
-	opcodes[0x25] = &CPU::opAND<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0x35] = &CPU::opAND<MEM_ZERO_PAGE_INDEXED_X>;
-	opcodes[0x2d] = &CPU::opAND<MEM_ABSOLUTE>;
-	opcodes[0x3d] = &CPU::opAND<MEM_INDEXED_X>;
-	opcodes[0x39] = &CPU::opAND<MEM_INDEXED_Y>;
-	opcodes[0x21] = &CPU::opAND<MEM_PRE_INDEXED_INDIRECT>;
-	opcodes[0x31] = &CPU::opAND<MEM_POST_INDEXED_INDIRECT>;
+	instruction.opcode = memory.readByte(address);
+	instruction.length = getInstructionLength(instructionTable[instruction.opcode].mode);
+	instruction.operand.w = 0;
+	if( instruction.length > 1 )
+	{
+		instruction.operand.l = memory.readByte(address + 1);
+	}
+	if( instruction.length > 2 )
+	{
+		instruction.operand.h = memory.readByte(address + 2);
+	}
+}
 
+template <typename Opcode>
+void CPU::execute( Opcode opcode )
+{
+	switch( opcode )
+	{
+	// ADC
+	case 0x69:
+		opADC<MEM_IMMEDIATE>();
+		break;
+	case 0x65:
+		opADC<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0x75:
+		opADC<MEM_ZERO_PAGE_INDEXED_X>();
+		break;
+	case 0x6d:
+		opADC<MEM_ABSOLUTE>();
+		break;
+	case 0x7d:
+		opADC<MEM_INDEXED_X>();
+		break;
+	case 0x79:
+		opADC<MEM_INDEXED_Y>();
+		break;
+	case 0x61:
+		opADC<MEM_PRE_INDEXED_INDIRECT>();
+		break;
+	case 0x71:
+		opADC<MEM_POST_INDEXED_INDIRECT>();
+		break;
+	// AND
+	case 0x29:
+		opAND<MEM_IMMEDIATE>();
+		break;
+	case 0x25:
+		opAND<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0x35:
+		opAND<MEM_ZERO_PAGE_INDEXED_X>();
+		break;
+	case 0x2d:
+		opAND<MEM_ABSOLUTE>();
+		break;
+	case 0x3d:
+		opAND<MEM_INDEXED_X>();
+		break;
+	case 0x39:
+		opAND<MEM_INDEXED_Y>();
+		break;
+	case 0x21:
+		opAND<MEM_PRE_INDEXED_INDIRECT>();
+		break;
+	case 0x31:
+		opAND<MEM_POST_INDEXED_INDIRECT>();
+		break;
 	// ASL
-	opcodes[0x0a] = &CPU::opASLAccumulator;
-	opcodes[0x06] = &CPU::opASL<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0x16] = &CPU::opASL<MEM_ZERO_PAGE_INDEXED_X>;
-	opcodes[0x0e] = &CPU::opASL<MEM_ABSOLUTE>;
-	opcodes[0x1e] = &CPU::opASL<MEM_INDEXED_X>;
-
+	case 0x0a:
+		opASLAccumulator();
+		break;
+	case 0x06:
+		opASL<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0x16:
+		opASL<MEM_ZERO_PAGE_INDEXED_X>();
+		break;
+	case 0x0e:
+		opASL<MEM_ABSOLUTE>();
+		break;
+	case 0x1e:
+		opASL<MEM_INDEXED_X>();
+		break;
 	// BCC
-	opcodes[0x90] = &CPU::opBCC;
-
+	case 0x90:
+		opBCC();
+		break;
 	// BCS
-	opcodes[0xb0] = &CPU::opBCS;
-
+	case 0xb0:
+		opBCS();
+		break;
 	// BEQ
-	opcodes[0xf0] = &CPU::opBEQ;
-
+	case 0xf0:
+		opBEQ();
+		break;
 	// BIT
-	opcodes[0x24] = &CPU::opBIT<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0x2c] = &CPU::opBIT<MEM_ABSOLUTE>;
-
+	case 0x24:
+		opBIT<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0x2c:
+		opBIT<MEM_ABSOLUTE>();
+		break;
 	// BMI
-	opcodes[0x30] = &CPU::opBMI;
-
+	case 0x30:
+		opBMI();
+		break;
 	// BNE
-	opcodes[0xd0] = &CPU::opBNE;
-
+	case 0xd0:
+		opBNE();
+		break;
 	// BPL
-	opcodes[0x10] = &CPU::opBPL;
-
+	case 0x10:
+		opBPL();
+		break;
+	// BVC
+	case 0x50:
+		opBVC();
+		break;
+	// BVS
+	case 0x70:
+		opBVS();
+		break;
 	// CLC
-	opcodes[0x18] = &CPU::opCLC;
-
+	case 0x18:
+		opCLC();
+		break;
 	// CLD
-	opcodes[0xd8] = &CPU::opCLD;
-
+	case 0xd8:
+		opCLD();
+		break;
+	// CLI
+	case 0x58:
+		opCLI();
+		break;
 	// CMP
-	opcodes[0xc9] = &CPU::opCMP<MEM_IMMEDIATE>;
-	opcodes[0xc5] = &CPU::opCMP<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0xd5] = &CPU::opCMP<MEM_ZERO_PAGE_INDEXED_X>;
-	opcodes[0xcd] = &CPU::opCMP<MEM_ABSOLUTE>;
-	opcodes[0xdd] = &CPU::opCMP<MEM_INDEXED_X>;
-	opcodes[0xd9] = &CPU::opCMP<MEM_INDEXED_Y>;
-	opcodes[0xc1] = &CPU::opCMP<MEM_PRE_INDEXED_INDIRECT>;
-	opcodes[0xd1] = &CPU::opCMP<MEM_POST_INDEXED_INDIRECT>;
-
+	case 0xc9:
+		opCMP<MEM_IMMEDIATE>();
+		break;
+	case 0xc5:
+		opCMP<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0xd5:
+		opCMP<MEM_ZERO_PAGE_INDEXED_X>();
+		break;
+	case 0xcd:
+		opCMP<MEM_ABSOLUTE>();
+		break;
+	case 0xdd:
+		opCMP<MEM_INDEXED_X>();
+		break;
+	case 0xd9:
+		opCMP<MEM_INDEXED_Y>();
+		break;
+	case 0xc1:
+		opCMP<MEM_PRE_INDEXED_INDIRECT>();
+		break;
+	case 0xd1:
+		opCMP<MEM_POST_INDEXED_INDIRECT>();
+		break;
 	// CPX
-	opcodes[0xe0] = &CPU::opCPX<MEM_IMMEDIATE>;
-	opcodes[0xe4] = &CPU::opCPX<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0xec] = &CPU::opCPX<MEM_ABSOLUTE>;
-
+	case 0xe0:
+		opCPX<MEM_IMMEDIATE>();
+		break;
+	case 0xe4:
+		opCPX<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0xec:
+		opCPX<MEM_ABSOLUTE>();
+		break;
 	// CPY
-	opcodes[0xc0] = &CPU::opCPY<MEM_IMMEDIATE>;
-	opcodes[0xc4] = &CPU::opCPY<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0xcc] = &CPU::opCPY<MEM_ABSOLUTE>;
-
+	case 0xc0:
+		opCPY<MEM_IMMEDIATE>();
+		break;
+	case 0xc4:
+		opCPY<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0xcc:
+		opCPY<MEM_ABSOLUTE>();
+		break;
 	// DEC
-	opcodes[0xc6] = &CPU::opDEC<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0xd6] = &CPU::opDEC<MEM_ZERO_PAGE_INDEXED_X>;
-	opcodes[0xce] = &CPU::opDEC<MEM_ABSOLUTE>;
-	opcodes[0xde] = &CPU::opDEC<MEM_INDEXED_X>;
-
+	case 0xc6:
+		opDEC<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0xd6:
+		opDEC<MEM_ZERO_PAGE_INDEXED_X>();
+		break;
+	case 0xce:
+		opDEC<MEM_ABSOLUTE>();
+		break;
+	case 0xde:
+		opDEC<MEM_INDEXED_X>();
+		break;
 	// DEX
-	opcodes[0xca] = &CPU::opDEX;
-
+	case 0xca:
+		opDEX();
+		break;
 	// DEY
-	opcodes[0x88] = &CPU::opDEY;
-
+	case 0x88:
+		opDEY();
+		break;
 	// EOR
-	opcodes[0x49] = &CPU::opEOR<MEM_IMMEDIATE>;
-	opcodes[0x45] = &CPU::opEOR<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0x55] = &CPU::opEOR<MEM_ZERO_PAGE_INDEXED_X>;
-	opcodes[0x4d] = &CPU::opEOR<MEM_ABSOLUTE>;
-	opcodes[0x5d] = &CPU::opEOR<MEM_INDEXED_X>;
-	opcodes[0x59] = &CPU::opEOR<MEM_INDEXED_Y>;
-	opcodes[0x41] = &CPU::opEOR<MEM_PRE_INDEXED_INDIRECT>;
-	opcodes[0x51] = &CPU::opEOR<MEM_POST_INDEXED_INDIRECT>;
-
+	case 0x49:
+		opEOR<MEM_IMMEDIATE>();
+		break;
+	case 0x45:
+		opEOR<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0x55:
+		opEOR<MEM_ZERO_PAGE_INDEXED_X>();
+		break;
+	case 0x4d:
+		opEOR<MEM_ABSOLUTE>();
+		break;
+	case 0x5d:
+		opEOR<MEM_INDEXED_X>();
+		break;
+	case 0x59:
+		opEOR<MEM_INDEXED_Y>();
+		break;
+	case 0x41:
+		opEOR<MEM_PRE_INDEXED_INDIRECT>();
+		break;
+	case 0x51:
+		opEOR<MEM_POST_INDEXED_INDIRECT>();
+		break;
 	// INC
-	opcodes[0xe6] = &CPU::opINC<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0xf6] = &CPU::opINC<MEM_ZERO_PAGE_INDEXED_X>;
-	opcodes[0xee] = &CPU::opINC<MEM_ABSOLUTE>;
-	opcodes[0xfe] = &CPU::opINC<MEM_INDEXED_X>;
-
+	case 0xe6:
+		opINC<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0xf6:
+		opINC<MEM_ZERO_PAGE_INDEXED_X>();
+		break;
+	case 0xee:
+		opINC<MEM_ABSOLUTE>();
+		break;
+	case 0xfe:
+		opINC<MEM_INDEXED_X>();
+		break;
 	// INX
-	opcodes[0xe8] = &CPU::opINX;
-
+	case 0xe8:
+		opINX();
+		break;
 	// INY
-	opcodes[0xc8] = &CPU::opINY;
-
+	case 0xc8:
+		opINY();
+		break;
 	// JMP
-	opcodes[0x4c] = &CPU::opJMP<MEM_ABSOLUTE>;
-	opcodes[0x6c] = &CPU::opJMP<MEM_INDIRECT>;
-
+	case 0x4c:
+		opJMP<MEM_ABSOLUTE>();
+		break;
+	case 0x6c:
+		opJMP<MEM_INDIRECT>();
+		break;
 	// JSR
-	opcodes[0x20] = &CPU::opJSR;
-
+	case 0x20:
+		opJSR();
+		break;
 	// LDA
-	opcodes[0xa9] = &CPU::opLDA<MEM_IMMEDIATE>;
-	opcodes[0xa5] = &CPU::opLDA<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0xb5] = &CPU::opLDA<MEM_ZERO_PAGE_INDEXED_X>;
-	opcodes[0xad] = &CPU::opLDA<MEM_ABSOLUTE>;
-	opcodes[0xbd] = &CPU::opLDA<MEM_INDEXED_X>;
-	opcodes[0xb9] = &CPU::opLDA<MEM_INDEXED_Y>;
-	opcodes[0xa1] = &CPU::opLDA<MEM_PRE_INDEXED_INDIRECT>;
-	opcodes[0xb1] = &CPU::opLDA<MEM_POST_INDEXED_INDIRECT>;
-
+	case 0xa9:
+		opLDA<MEM_IMMEDIATE>();
+		break;
+	case 0xa5:
+		opLDA<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0xb5:
+		opLDA<MEM_ZERO_PAGE_INDEXED_X>();
+		break;
+	case 0xad:
+		opLDA<MEM_ABSOLUTE>();
+		break;
+	case 0xbd:
+		opLDA<MEM_INDEXED_X>();
+		break;
+	case 0xb9:
+		opLDA<MEM_INDEXED_Y>();
+		break;
+	case 0xa1:
+		opLDA<MEM_PRE_INDEXED_INDIRECT>();
+		break;
+	case 0xb1:
+		opLDA<MEM_POST_INDEXED_INDIRECT>();
+		break;
 	// LDX
-	opcodes[0xa2] = &CPU::opLDX<MEM_IMMEDIATE>;
-	opcodes[0xa6] = &CPU::opLDX<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0xb6] = &CPU::opLDX<MEM_ZERO_PAGE_INDEXED_Y>;
-	opcodes[0xae] = &CPU::opLDX<MEM_ABSOLUTE>;
-	opcodes[0xbe] = &CPU::opLDX<MEM_INDEXED_Y>;
-
+	case 0xa2:
+		opLDX<MEM_IMMEDIATE>();
+		break;
+	case 0xa6:
+		opLDX<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0xb6:
+		opLDX<MEM_ZERO_PAGE_INDEXED_Y>();
+		break;
+	case 0xae:
+		opLDX<MEM_ABSOLUTE>();
+		break;
+	case 0xbe:
+		opLDX<MEM_INDEXED_Y>();
+		break;
 	// LDY
-	opcodes[0xa0] = &CPU::opLDY<MEM_IMMEDIATE>;
-	opcodes[0xa4] = &CPU::opLDY<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0xb4] = &CPU::opLDY<MEM_ZERO_PAGE_INDEXED_X>;
-	opcodes[0xac] = &CPU::opLDY<MEM_ABSOLUTE>;
-	opcodes[0xbc] = &CPU::opLDY<MEM_INDEXED_X>;
-
+	case 0xa0:
+		opLDY<MEM_IMMEDIATE>();
+		break;
+	case 0xa4:
+		opLDY<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0xb4:
+		opLDY<MEM_ZERO_PAGE_INDEXED_X>();
+		break;
+	case 0xac:
+		opLDY<MEM_ABSOLUTE>();
+		break;
+	case 0xbc:
+		opLDY<MEM_INDEXED_X>();
+		break;
 	// LSR
-	opcodes[0x4a] = &CPU::opLSRAccumulator;
-	opcodes[0x46] = &CPU::opLSR<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0x56] = &CPU::opLSR<MEM_ZERO_PAGE_INDEXED_X>;
-	opcodes[0x4e] = &CPU::opLSR<MEM_ABSOLUTE>;
-	opcodes[0x5e] = &CPU::opLSR<MEM_INDEXED_X>;
-
+	case 0x4a:
+		opLSRAccumulator();
+		break;
+	case 0x46:
+		opLSR<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0x56:
+		opLSR<MEM_ZERO_PAGE_INDEXED_X>();
+		break;
+	case 0x4e:
+		opLSR<MEM_ABSOLUTE>();
+		break;
+	case 0x5e:
+		opLSR<MEM_INDEXED_X>();
+		break;
 	// NOP
-	opcodes[0xea] = &CPU::opNOP;
-
+	case 0xea:
+		opNOP();
+		break;
 	// ORA
-	opcodes[0x09] = &CPU::opORA<MEM_IMMEDIATE>;
-	opcodes[0x05] = &CPU::opORA<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0x15] = &CPU::opORA<MEM_ZERO_PAGE_INDEXED_X>;
-	opcodes[0x0d] = &CPU::opORA<MEM_ABSOLUTE>;
-	opcodes[0x1d] = &CPU::opORA<MEM_INDEXED_X>;
-	opcodes[0x19] = &CPU::opORA<MEM_INDEXED_Y>;
-	opcodes[0x01] = &CPU::opORA<MEM_PRE_INDEXED_INDIRECT>;
-	opcodes[0x11] = &CPU::opORA<MEM_POST_INDEXED_INDIRECT>;
-
+	case 0x09:
+		opORA<MEM_IMMEDIATE>();
+		break;
+	case 0x05:
+		opORA<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0x15:
+		opORA<MEM_ZERO_PAGE_INDEXED_X>();
+		break;
+	case 0x0d:
+		opORA<MEM_ABSOLUTE>();
+		break;
+	case 0x1d:
+		opORA<MEM_INDEXED_X>();
+		break;
+	case 0x19:
+		opORA<MEM_INDEXED_Y>();
+		break;
+	case 0x01:
+		opORA<MEM_PRE_INDEXED_INDIRECT>();
+		break;
+	case 0x11:
+		opORA<MEM_POST_INDEXED_INDIRECT>();
+		break;
 	// PHA
-	opcodes[0x48] = &CPU::opPHA;
-
+	case 0x48:
+		opPHA();
+		break;
 	// PHP
-	opcodes[0x08] = &CPU::opPHP;
-
+	case 0x08:
+		opPHP();
+		break;
 	// PLA
-	opcodes[0x68] = &CPU::opPLA;
-
+	case 0x68:
+		opPLA();
+		break;
 	// PLP
-	opcodes[0x28] = &CPU::opPLP;
-
+	case 0x28:
+		opPLP();
+		break;
 	// ROL
-	opcodes[0x2a] = &CPU::opROLAccumulator;
-	opcodes[0x26] = &CPU::opROL<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0x36] = &CPU::opROL<MEM_ZERO_PAGE_INDEXED_X>;
-	opcodes[0x2e] = &CPU::opROL<MEM_ABSOLUTE>;
-	opcodes[0x3e] = &CPU::opROL<MEM_INDEXED_X>;
-
+	case 0x2a:
+		opROLAccumulator();
+		break;
+	case 0x26:
+		opROL<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0x36:
+		opROL<MEM_ZERO_PAGE_INDEXED_X>();
+		break;
+	case 0x2e:
+		opROL<MEM_ABSOLUTE>();
+		break;
+	case 0x3e:
+		opROL<MEM_INDEXED_X>();
+		break;
 	// ROR
-	opcodes[0x6a] = &CPU::opRORAccumulator;
-	opcodes[0x66] = &CPU::opROR<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0x76] = &CPU::opROR<MEM_ZERO_PAGE_INDEXED_X>;
-	opcodes[0x6e] = &CPU::opROR<MEM_ABSOLUTE>;
-	opcodes[0x7e] = &CPU::opROR<MEM_INDEXED_X>;
-
+	case 0x6a:
+		opRORAccumulator();
+		break;
+	case 0x66:
+		opROR<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0x76:
+		opROR<MEM_ZERO_PAGE_INDEXED_X>();
+		break;
+	case 0x6e:
+		opROR<MEM_ABSOLUTE>();
+		break;
+	case 0x7e:
+		opROR<MEM_INDEXED_X>();
+		break;
 	// RTI
-	opcodes[0x40] = &CPU::opRTI;
-
+	case 0x40:
+		opRTI();
+		break;
 	// RTS
-	opcodes[0x60] = &CPU::opRTS;
-
+	case 0x60:
+		opRTS();
+		break;
 	// SBC
-	opcodes[0xe9] = &CPU::opSBC<MEM_IMMEDIATE>;
-	opcodes[0xe5] = &CPU::opSBC<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0xf5] = &CPU::opSBC<MEM_ZERO_PAGE_INDEXED_X>;
-	opcodes[0xed] = &CPU::opSBC<MEM_ABSOLUTE>;
-	opcodes[0xfd] = &CPU::opSBC<MEM_INDEXED_X>;
-	opcodes[0xf9] = &CPU::opSBC<MEM_INDEXED_Y>;
-	opcodes[0xe1] = &CPU::opSBC<MEM_PRE_INDEXED_INDIRECT>;
-	opcodes[0xf1] = &CPU::opSBC<MEM_POST_INDEXED_INDIRECT>;
-
+	case 0xe9:
+		opSBC<MEM_IMMEDIATE>();
+		break;
+	case 0xe5:
+		opSBC<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0xf5:
+		opSBC<MEM_ZERO_PAGE_INDEXED_X>();
+		break;
+	case 0xed:
+		opSBC<MEM_ABSOLUTE>();
+		break;
+	case 0xfd:
+		opSBC<MEM_INDEXED_X>();
+		break;
+	case 0xf9:
+		opSBC<MEM_INDEXED_Y>();
+		break;
+	case 0xe1:
+		opSBC<MEM_PRE_INDEXED_INDIRECT>();
+		break;
+	case 0xf1:
+		opSBC<MEM_POST_INDEXED_INDIRECT>();
+		break;
 	// SEC
-	opcodes[0x38] = &CPU::opSEC;
-
+	case 0x38:
+		opSEC();
+		break;
 	// SEI
-	opcodes[0x78] = &CPU::opSEI;
-
+	case 0x78:
+		opSEI();
+		break;
 	// STA
-	opcodes[0x85] = &CPU::opSTA<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0x95] = &CPU::opSTA<MEM_ZERO_PAGE_INDEXED_X>;
-	opcodes[0x8d] = &CPU::opSTA<MEM_ABSOLUTE>;
-	opcodes[0x9d] = &CPU::opSTA<MEM_INDEXED_X>;
-	opcodes[0x99] = &CPU::opSTA<MEM_INDEXED_Y>;
-	opcodes[0x81] = &CPU::opSTA<MEM_PRE_INDEXED_INDIRECT>;
-	opcodes[0x91] = &CPU::opSTA<MEM_POST_INDEXED_INDIRECT>;
-
+	case 0x85:
+		opSTA<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0x95:
+		opSTA<MEM_ZERO_PAGE_INDEXED_X>();
+		break;
+	case 0x8d:
+		opSTA<MEM_ABSOLUTE>();
+		break;
+	case 0x9d:
+		opSTA<MEM_INDEXED_X>();
+		break;
+	case 0x99:
+		opSTA<MEM_INDEXED_Y>();
+		break;
+	case 0x81:
+		opSTA<MEM_PRE_INDEXED_INDIRECT>();
+		break;
+	case 0x91:
+		opSTA<MEM_POST_INDEXED_INDIRECT>();
+		break;
 	// STX
-	opcodes[0x86] = &CPU::opSTX<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0x96] = &CPU::opSTX<MEM_ZERO_PAGE_INDEXED_Y>;
-	opcodes[0x8e] = &CPU::opSTX<MEM_ABSOLUTE>;
-
+	case 0x86:
+		opSTX<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0x96:
+		opSTX<MEM_ZERO_PAGE_INDEXED_Y>();
+		break;
+	case 0x8e:
+		opSTX<MEM_ABSOLUTE>();
+		break;
 	// STY
-	opcodes[0x84] = &CPU::opSTY<MEM_ZERO_PAGE_ABSOLUTE>;
-	opcodes[0x94] = &CPU::opSTY<MEM_ZERO_PAGE_INDEXED_X>;
-	opcodes[0x8c] = &CPU::opSTY<MEM_ABSOLUTE>;
-
+	case 0x84:
+		opSTY<MEM_ZERO_PAGE_ABSOLUTE>();
+		break;
+	case 0x94:
+		opSTY<MEM_ZERO_PAGE_INDEXED_X>();
+		break;
+	case 0x8c:
+		opSTY<MEM_ABSOLUTE>();
+		break;
 	// TAX
-	opcodes[0xaa] = &CPU::opTAX;
-
+	case 0xaa:
+		opTAX();
+		break;
 	// TAY
-	opcodes[0xa8] = &CPU::opTAY;
-
+	case 0xa8:
+		opTAY();
+		break;
 	// TSX
-	opcodes[0xba] = &CPU::opTSX;
-
+	case 0xba:
+		opTSX();
+		break;
 	// TXA
-	opcodes[0x8a] = &CPU::opTXA;
-
+	case 0x8a:
+		opTXA();
+		break;
 	// TXS
-	opcodes[0x9a] = &CPU::opTXS;
-
+	case 0x9a:
+		opTXS();
+		break;
 	// TYA
-	opcodes[0x98] = &CPU::opTYA;
+	case 0x98:
+		opTYA();
+		break;
+	default:
+		std::cout << boost::format("Error: unimplemented opcode: %02X (%s)") % (uint16_t)opcode % instructionTable[opcode].name << std::endl;
+		exit(-1);
+		break;
+	}
+}
+
+template <uint8_t Opcode>
+void CPU::executeOpcode( CPU& cpu )
+{
+	cpu.execute(std::integral_constant<uint8_t, Opcode>());
 }
 
 uint8_t CPU::getImmediate8()
 {
-	uint8_t value = nes.getMemory().readByte(registers.pc.w);
+	// The operand was already fetched when the instruction was decoded
 	registers.pc.w++;
 
-	return value;
+	return operand.l;
 }
 
 uint16_t CPU::getImmediate16()
 {
-	uint16_t value = nes.getMemory().readWord(registers.pc.w);
+	// The operand was already fetched when the instruction was decoded
 	registers.pc.w += 2;
 
-	return value;
+	return operand.w;
+}
+
+bool CPU::isIRQPending() const
+{
+	return irqLine && !registers.p.interrupt;
 }
 
 template <MemoryAddressingMode M>
-MemoryAccess CPU::getMemory()
+uint16_t CPU::getAddress()
 {
 	switch(M)
 	{
-	case MEM_IMMEDIATE:
-		{
-			uint16_t pc = registers.pc.w;
-			registers.pc.w++;
-			return MemoryAccess(nes.getMemory(), pc);
-		}
 	case MEM_ABSOLUTE:
-		return MemoryAccess(nes.getMemory(), getImmediate16());
+		return getImmediate16();
 	case MEM_ZERO_PAGE_ABSOLUTE:
-		return MemoryAccess(nes.getMemory(), getImmediate8());
+		return getImmediate8();
 	case MEM_INDEXED_X:
-		return MemoryAccess(nes.getMemory(), getImmediate16() + registers.x);
+		return getImmediate16() + registers.x;
 	case MEM_INDEXED_Y:
-		return MemoryAccess(nes.getMemory(), getImmediate16() + registers.y);
+		return getImmediate16() + registers.y;
 	case MEM_ZERO_PAGE_INDEXED_X:
-		return MemoryAccess(nes.getMemory(), getImmediate8() + registers.x);
+		return getImmediate8() + registers.x;
 	case MEM_ZERO_PAGE_INDEXED_Y:
-		return MemoryAccess(nes.getMemory(), getImmediate8() + registers.y);
+		return getImmediate8() + registers.y;
 	case MEM_INDIRECT:
-		return MemoryAccess(nes.getMemory(), nes.getMemory().readWord(getImmediate16()));
+		return nes.getMemory().readWord(getImmediate16());
 	case MEM_PRE_INDEXED_INDIRECT:
-		return MemoryAccess(nes.getMemory(), nes.getMemory().readWord(getImmediate8() + registers.x));
+		{
+			// The pointer is always in zero page
+			uint16_t pointer = getImmediate8() + registers.x;
+			return (uint16_t)ram[pointer] | ((uint16_t)ram[pointer + 1] << 8);
+		}
 	case MEM_POST_INDEXED_INDIRECT:
-		return MemoryAccess(nes.getMemory(), nes.getMemory().readWord(getImmediate8()) + registers.y);
-	case MEM_RELATIVE:
 		{
-			uint16_t address;
-			uint16_t offset = getImmediate8();
-			if( offset < 0x80 )
-			{
-				address = getImmediate8() + offset;
-			}
-			else
-			{
-				address = getImmediate8() + offset - 0x100;
-			}
-			return MemoryAccess(nes.getMemory(), address);
+			// The pointer is always in zero page
+			uint16_t pointer = getImmediate8();
+			return ((uint16_t)ram[pointer] | ((uint16_t)ram[pointer + 1] << 8)) + registers.y;
 		}
+	default:
+		return 0;
 	}
 }
 
 void CPU::powerOn()
 {
 	// Reset the CPU to power on state
-	registers.p.raw = 0x34;
+	registers.setP(0x34);
 	registers.a = 0;
 	registers.x = 0;
 	registers.y = 0;
 	registers.s = 0xfd;
 
 	interrupt = INTERRUPT_NONE;
+	irqLine = false;
 
 	// Jump to the reset vector for the first instruction
 	registers.pc.w = nes.getMemory().readWord(VECTOR_RESET);
@@ -467,28 +1111,258 @@ void CPU::powerOn()
 uint8_t CPU::pull()
 {
 	registers.s++;
-	return nes.getMemory().readByte(0x100 | (uint16_t)registers.s);
+	return ram[0x100 | (uint16_t)registers.s];
 }
 
 void CPU::push( uint8_t value )
 {
-	nes.getMemory().writeByte(0x100 | (uint16_t)registers.s, value);
+	ram[0x100 | (uint16_t)registers.s] = value;
 	registers.s--;
 }
 
+template <MemoryAddressingMode M>
+uint8_t CPU::readMemory( uint16_t address )
+{
+	switch(M)
+	{
+	case MEM_ZERO_PAGE_ABSOLUTE:
+	case MEM_ZERO_PAGE_INDEXED_X:
+	case MEM_ZERO_PAGE_INDEXED_Y:
+		return ram[address];
+	default:
+		return nes.getMemory().readByte(address);
+	}
+}
+
+template <MemoryAddressingMode M>
+uint8_t CPU::readOperand()
+{
+	// Immediate operands were already fetched when the instruction was decoded
+	if( M == MEM_IMMEDIATE )
+	{
+		registers.pc.w++;
+		return operand.l;
+	}
+
+	return readMemory<M>(getAddress<M>());
+}
+
 void CPU::requestNMI()
 {
 	interrupt = INTERRUPT_NMI;
 }
 
+int CPU::run( int cycleBudget )
+{
+	int cycles = 0;
+
+	if( executionMode != EXECUTION_INTERPRETER )
+	{
+		// Blocks can only run when no interrupt is pending, since interrupts
+		// are only taken between instructions by step()
+		while( interrupt == INTERRUPT_NONE && !isIRQPending() )
+		{
+			int offset = nes.getMemory().getPrgOffset(registers.pc.w, 3);
+			if( offset < 0 )
+			{
+				break;
+			}
+
+			TranslatedBlock*& block = blockCache[offset];
+			if( block == nullptr )
+			{
+				block = translate(registers.pc.w);
+			}
+			if( block->length == 0 || cycles + block->cycles > cycleBudget )
+			{
+				break;
+			}
+
+			// The rest of the block may have been switched out since it was
+			// translated
+			if( nes.getMemory().getPrgOffset(registers.pc.w, block->size) != offset )
+			{
+				break;
+			}
+
+			Registers startRegisters = registers;
+			if( executionMode == EXECUTION_VERIFY )
+			{
+				cycles += verifyBlock(*block);
+			}
+			else
+			{
+				cycles += runBlock(*block);
+			}
+
+			// An idle loop that ends in the state it started in will keep
+			// doing that until an interrupt, so skip every iteration that
+			// fits in the budget
+			if( block->idle && registers == startRegisters )
+			{
+				cycles += ((cycleBudget - cycles) / block->cycles) * block->cycles;
+			}
+			loopStart = registers.pc.w <= startRegisters.pc.w;
+		}
+	}
+
+	// The interpreter doesn't run idle loops as blocks, and loops that poll
+	// PPUSTATUS can't be translated, so check for both where a backwards
+	// jump may have led to the start of one
+	if( cycles == 0 && loopStart )
+	{
+		cycles = skipLoop(cycleBudget);
+	}
+
+	// Fall back to the interpreter if no block could be run. The run ends
+	// after this instruction, since it may write to a register that
+	// schedules an event before the end of the budget.
+	if( cycles == 0 )
+	{
+		uint16_t address = registers.pc.w;
+		cycles = step();
+		loopStart = registers.pc.w <= address;
+	}
+
+	return cycles;
+}
+
+int CPU::runBlock( const TranslatedBlock& block )
+{
+	for( int i = 0; i < block.length; i++ )
+	{
+		operand = block.instructions[i].operand;
+		registers.pc.w++;
+		block.instructions[i].handler(*this);
+	}
+
+	return block.cycles;
+}
+
+void CPU::setExecutionMode( ExecutionMode mode )
+{
+	executionMode = mode;
+}
+
+void CPU::setIRQ( bool asserted )
+{
+	irqLine = asserted;
+}
+
 void CPU::setSign( uint8_t value )
 {
-	registers.p.sign = ((value & BIT_7) ? 1 : 0);
+	registers.signResult = value;
 }
 
 void CPU::setZero( uint8_t value )
 {
-	registers.p.zero = ((value == 0) ? 1 : 0);
+	registers.zeroResult = value;
+}
+
+int CPU::skipLoop( int cycleBudget )
+{
+	// Skipped iterations can't take an interrupt, so only skip while none
+	// is pending
+	if( interrupt != INTERRUPT_NONE || isIRQPending() )
+	{
+		return 0;
+	}
+
+	uint16_t start = registers.pc.w;
+	int offset = nes.getMemory().getPrgOffset(start, 3);
+	if( offset < 0 )
+	{
+		return 0;
+	}
+
+	TranslatedBlock*& block = blockCache[offset];
+	if( block == nullptr )
+	{
+		block = translate(start);
+	}
+
+	// An idle loop only touches the registers and internal RAM, so it can
+	// run all at once. If it ends in the state it started in, it will keep
+	// doing that until an interrupt.
+	if( block->length > 0 )
+	{
+		if( !block->idle || block->cycles > cycleBudget ||
+			nes.getMemory().getPrgOffset(start, block->size) != offset )
+		{
+			return 0;
+		}
+
+		Registers startRegisters = registers;
+		int cycles = 0;
+		for( int i = 0; i < block->length; i++ )
+		{
+			cycles += step();
+		}
+		if( registers == startRegisters )
+		{
+			cycles += ((cycleBudget - cycles) / block->cycles) * block->cycles;
+		}
+		return cycles;
+	}
+
+	// Otherwise look for LDA or BIT $2002 followed by BPL or BVC back to it,
+	// which waits for vblank or a sprite 0 hit
+	if( nes.getMemory().getPrgOffset(start, 5) != offset )
+	{
+		return 0;
+	}
+	DecodedInstruction& load = decodeCache[offset];
+	DecodedInstruction& branch = decodeCache[offset + 3];
+	if( branch.length == 0 )
+	{
+		decode(branch, start + 3);
+	}
+	if( (load.opcode != 0xad && load.opcode != 0x2c) || load.operand.w != 0x2002 ||
+		(branch.opcode != 0x10 && branch.opcode != 0x50) || branch.operand.l != 0xfb )
+	{
+		return 0;
+	}
+
+	// Catching the PPU up may schedule an event, such as a predicted sprite
+	// 0 hit, before the end of the budget
+	int64_t clock = nes.getScheduler().getClock();
+	int64_t changeTime = nes.getPPU().getStatusChangeTime();
+	int64_t eventBudget = (nes.getScheduler().getNextEventTime() - clock - 1) / 3;
+	if( eventBudget < cycleBudget )
+	{
+		cycleBudget = (int)eventBudget;
+	}
+
+	// Only the load reads memory, and it is the first thing in the run, so
+	// the whole iteration can run now as long as it ends before the next event
+	int iterationCycles = instructionTable[load.opcode].cycles + instructionTable[branch.opcode].cycles;
+	if( iterationCycles > cycleBudget )
+	{
+		return 0;
+	}
+
+	int cycles = step();
+	cycles += step();
+
+	// Every read before the status changes returns the same value, and
+	// the iteration just run left the registers holding what that value
+	// produces. Later iterations until then only take time. Each one reads
+	// at its start, one iteration after the last.
+	if( registers.pc.w == start )
+	{
+		int64_t iterations = (cycleBudget - cycles) / iterationCycles;
+		int64_t unchanged = (changeTime - clock - 1) / (3 * iterationCycles);
+		if( unchanged < iterations )
+		{
+			iterations = unchanged;
+		}
+		if( iterations > 0 )
+		{
+			cycles += (int)iterations * iterationCycles;
+		}
+	}
+
+	return cycles;
 }
 
 int CPU::step()
@@ -505,27 +1379,159 @@ int CPU::step()
 		registers.pc.w = nes.getMemory().readWord(VECTOR_NMI);
 		registers.p.interrupt = 1;
 		cycles += 7;
+		break;
 	default:
+		if( isIRQPending() )
+		{
+			push(registers.pc.h);
+			push(registers.pc.l);
+			push((registers.getP() & ~BIT_4) | BIT_5);
+			registers.pc.w = nes.getMemory().readWord(VECTOR_IRQ);
+			registers.p.interrupt = 1;
+			cycles += 7;
+		}
 		break;
 	}
 	interrupt = INTERRUPT_NONE;
 
-	// Fetch the opcode
-	uint8_t opcode = nes.getMemory().readByte(registers.pc.w);
-	if( opcodes[opcode] == nullptr )
+	// Fetch the opcode and operand. PRG ROM can't change, so instructions
+	// there are only decoded once. Anything else is always decoded.
+	DecodedInstruction decoded;
+	int offset = nes.getMemory().getPrgOffset(registers.pc.w, 3);
+	if( offset >= 0 )
 	{
-		std::cout << boost::format("Error: unimplemented opcode: %02X") % (uint16_t)opcode << std::endl;
-		exit(-1);
+		DecodedInstruction& cached = decodeCache[offset];
+		if( cached.length == 0 )
+		{
+			decode(cached, registers.pc.w);
+		}
+		decoded = cached;
+	}
+	else
+	{
+		decode(decoded, registers.pc.w);
 	}
+	uint8_t opcode = decoded.opcode;
+	operand = decoded.operand;
+	const InstructionInfo& instruction = instructionTable[opcode];
 
-	//std::cout << boost::format("%04X: %s %02X %02X\n") % registers.pc.w % instructionNames[opcode] % (uint16_t)nes.getMemory().readByte(registers.pc.w + 1) % (uint16_t)nes.getMemory().readByte(registers.pc.w + 2);
+	//std::cout << boost::format("%04X: %s %02X %02X\n") % registers.pc.w % instruction.name % (uint16_t)nes.getMemory().readByte(registers.pc.w + 1) % (uint16_t)nes.getMemory().readByte(registers.pc.w + 2);
 
 	// Execute the instruction
 	registers.pc.w++;
-	((*this).*(opcodes[opcode]))();
+	execute(opcode);
 
 	///@todo more accurate cycle counting
-	cycles += instructionCycles[opcode];
+	cycles += instruction.cycles;
+	return cycles;
+}
+
+template <MemoryAddressingMode M>
+void CPU::writeMemory( uint16_t address, uint8_t value )
+{
+	switch(M)
+	{
+	case MEM_ZERO_PAGE_ABSOLUTE:
+	case MEM_ZERO_PAGE_INDEXED_X:
+	case MEM_ZERO_PAGE_INDEXED_Y:
+		ram[address] = value;
+		break;
+	default:
+		nes.getMemory().writeByte(address, value);
+		break;
+	}
+}
+
+CPU::TranslatedBlock* CPU::translate( uint16_t address )
+{
+	TranslatedBlock* block = new TranslatedBlock;
+	block->cycles = 0;
+	block->length = 0;
+	block->size = 0;
+	block->idle = false;
+
+	uint16_t start = address;
+	int startOffset = nes.getMemory().getPrgOffset(start, 3);
+	bool writes = false;
+
+	while( block->length < 32 )
+	{
+		// Stop where the code is no longer read contiguously from PRG ROM
+		int offset = nes.getMemory().getPrgOffset(address, 3);
+		if( offset < 0 || offset != startOffset + block->size )
+		{
+			break;
+		}
+
+		DecodedInstruction& instruction = decodeCache[offset];
+		if( instruction.length == 0 )
+		{
+			decode(instruction, address);
+		}
+		if( !isTranslatable(instruction.opcode, instruction.operand.w) )
+		{
+			break;
+		}
+
+		ThreadedInstruction& threaded = block->instructions[block->length++];
+		threaded.handler = opcodeHandlers[instruction.opcode];
+		threaded.operand = instruction.operand;
+		block->cycles += instructionTable[instruction.opcode].cycles;
+		block->size += instruction.length;
+		writes = writes || instructionTable[instruction.opcode].writes;
+		if( isBlockTerminator(instruction.opcode) )
+		{
+			// Check for a loop back to the start of the block
+			uint16_t target = 0;
+			if( instruction.opcode == 0x4c )
+			{
+				target = instruction.operand.w;
+			}
+			else if( instructionTable[instruction.opcode].mode == MEM_RELATIVE )
+			{
+				target = address + 2 + (int8_t)instruction.operand.l;
+			}
+			block->idle = (target == start && !writes);
+			break;
+		}
+		address += instruction.length;
+	}
+
+	return block;
+}
+
+int CPU::verifyBlock( const TranslatedBlock& block )
+{
+	// Blocks only touch the registers and internal RAM, so save those
+	uint8_t* ram = nes.getMemory().getRAM();
+	uint8_t startRAM[0x800];
+	memcpy(startRAM, ram, sizeof(startRAM));
+	Registers startRegisters = registers;
+	uint16_t address = registers.pc.w;
+
+	int cycles = runBlock(block);
+
+	uint8_t blockRAM[0x800];
+	memcpy(blockRAM, ram, sizeof(blockRAM));
+	Registers blockRegisters = registers;
+
+	// Run the same code again through the interpreter
+	memcpy(ram, startRAM, sizeof(startRAM));
+	registers = startRegisters;
+	int interpreterCycles = 0;
+	for( int i = 0; i < block.length; i++ )
+	{
+		interpreterCycles += step();
+	}
+
+	if( !(registers == blockRegisters) ||
+		cycles != interpreterCycles ||
+		memcmp(ram, blockRAM, sizeof(blockRAM)) != 0 )
+	{
+		std::cout << boost::format("Error: translated block at %04X does not match the interpreter") % address << std::endl;
+		exit(-1);
+	}
+
 	return cycles;
 }
 
@@ -536,7 +1542,7 @@ int CPU::step()
 template <MemoryAddressingMode M>
 void CPU::opADC()
 {
-	MemoryAccess src = getMemory<M>();
+	uint8_t src = readOperand<M>();
 	uint16_t temp = src + registers.a + (registers.p.carry ? 1 : 0);
 	setZero(temp & 0xff);
 	if( registers.p.decimal )
@@ -546,7 +1552,7 @@ void CPU::opADC()
 			temp += 6;
 		}
 		setSign(temp);
-		registers.p.overflow = (!((registers.a ^ src) & 0x80) && ((registers.a ^ temp) & 0x80));
+		registers.overflowResult = ~(registers.a ^ src) & (registers.a ^ temp);
 		if( temp > 0x99 )
 		{
 			temp += 96;
@@ -556,7 +1562,7 @@ void CPU::opADC()
 	else
 	{
 		setSign(temp);
-		registers.p.overflow = (!((registers.a ^ src) & 0x80) && ((registers.a ^ temp) & 0x80));
+		registers.overflowResult = ~(registers.a ^ src) & (registers.a ^ temp);
 		registers.p.carry = (temp > 0xff);
 	}
 	registers.a = (uint8_t)temp;
@@ -565,7 +1571,7 @@ void CPU::opADC()
 template <MemoryAddressingMode M>
 void CPU::opAND()
 {
-	MemoryAccess src = getMemory<M>();
+	uint8_t src = readOperand<M>();
 	registers.a &= src;
 	setSign(registers.a);
 	setZero(registers.a);
@@ -574,11 +1580,13 @@ void CPU::opAND()
 template <MemoryAddressingMode M>
 void CPU::opASL()
 {
-	MemoryAccess src = getMemory<M>();
-	registers.p.carry = (src & BIT_7);
-	src = (src << 1) & 0xfe;
-	setSign(src);
-	setZero(src);
+	uint16_t address = getAddress<M>();
+	uint8_t value = readMemory<M>(address);
+	registers.p.carry = (value & BIT_7);
+	value = (value << 1) & 0xfe;
+	writeMemory<M>(address, value);
+	setSign(value);
+	setZero(value);
 }
 
 void CPU::opASLAccumulator()
@@ -610,7 +1618,7 @@ void CPU::opBCS()
 void CPU::opBEQ()
 {
 	uint16_t address = registers.pc.w + (int8_t)getImmediate8() + 1;
-	if( registers.p.zero )
+	if( registers.zeroResult == 0 )
 	{
 		registers.pc.w = address;
 	}
@@ -619,16 +1627,16 @@ void CPU::opBEQ()
 template <MemoryAddressingMode M>
 void CPU::opBIT()
 {
-	MemoryAccess src = getMemory<M>();
+	uint8_t src = readOperand<M>();
 	setSign(src);
-	registers.p.overflow = (0x40 & src);
+	registers.overflowResult = src << 1;
 	setZero(src & registers.a);
 }
 
 void CPU::opBMI()
 {
 	uint16_t address = registers.pc.w + (int8_t)getImmediate8() + 1;
-	if( registers.p.sign )
+	if( registers.signResult & BIT_7 )
 	{
 		registers.pc.w = address;
 	}
@@ -637,7 +1645,7 @@ void CPU::opBMI()
 void CPU::opBNE()
 {
 	uint16_t address = registers.pc.w + (int8_t)getImmediate8() + 1;
-	if( !registers.p.zero )
+	if( registers.zeroResult != 0 )
 	{
 		registers.pc.w = address;
 	}
@@ -646,7 +1654,25 @@ void CPU::opBNE()
 void CPU::opBPL()
 {
 	uint16_t address = registers.pc.w + (int8_t)getImmediate8() + 1;
-	if( !registers.p.sign )
+	if( !(registers.signResult & BIT_7) )
+	{
+		registers.pc.w = address;
+	}
+}
+
+void CPU::opBVC()
+{
+	uint16_t address = registers.pc.w + (int8_t)getImmediate8() + 1;
+	if( !(registers.overflowResult & BIT_7) )
+	{
+		registers.pc.w = address;
+	}
+}
+
+void CPU::opBVS()
+{
+	uint16_t address = registers.pc.w + (int8_t)getImmediate8() + 1;
+	if( registers.overflowResult & BIT_7 )
 	{
 		registers.pc.w = address;
 	}
@@ -662,10 +1688,15 @@ void CPU::opCLD()
 	registers.p.decimal = 0;
 }
 
+void CPU::opCLI()
+{
+	registers.p.interrupt = 0;
+}
+
 template <MemoryAddressingMode M>
 void CPU::opCMP()
 {
-	MemoryAccess src = getMemory<M>();
+	uint8_t src = readOperand<M>();
 	uint8_t value = registers.a - src;
 	registers.p.carry = ((registers.a >= src) ? 1 : 0);
 	setSign(value);
@@ -675,7 +1706,7 @@ void CPU::opCMP()
 template <MemoryAddressingMode M>
 void CPU::opCPX()
 {
-	MemoryAccess src = getMemory<M>();
+	uint8_t src = readOperand<M>();
 	uint8_t value = registers.x - src;
 	registers.p.carry = ((registers.x >= src) ? 1 : 0);
 	setSign(value);
@@ -685,7 +1716,7 @@ void CPU::opCPX()
 template <MemoryAddressingMode M>
 void CPU::opCPY()
 {
-	MemoryAccess src = getMemory<M>();
+	uint8_t src = readOperand<M>();
 	uint8_t value = registers.y - src;
 	registers.p.carry = ((registers.y >= src) ? 1 : 0);
 	setSign(value);
@@ -695,10 +1726,11 @@ void CPU::opCPY()
 template <MemoryAddressingMode M>
 void CPU::opDEC()
 {
-	MemoryAccess src = getMemory<M>();
-	src = src - 1;
-	setSign(src);
-	setZero(src);
+	uint16_t address = getAddress<M>();
+	uint8_t value = readMemory<M>(address) - 1;
+	writeMemory<M>(address, value);
+	setSign(value);
+	setZero(value);
 }
 
 void CPU::opDEX()
@@ -718,7 +1750,7 @@ void CPU::opDEY()
 template <MemoryAddressingMode M>
 void CPU::opEOR()
 {
-	MemoryAccess src = getMemory<M>();
+	uint8_t src = readOperand<M>();
 	registers.a ^= src;
 	setSign(registers.a);
 	setZero(registers.a);
@@ -727,10 +1759,11 @@ void CPU::opEOR()
 template <MemoryAddressingMode M>
 void CPU::opINC()
 {
-	MemoryAccess src = getMemory<M>();
-	src = src + 1;
-	setSign(src);
-	setZero(src);
+	uint16_t address = getAddress<M>();
+	uint8_t value = readMemory<M>(address) + 1;
+	writeMemory<M>(address, value);
+	setSign(value);
+	setZero(value);
 }
 
 void CPU::opINX()
@@ -750,8 +1783,7 @@ void CPU::opINY()
 template <MemoryAddressingMode M>
 void CPU::opJMP()
 {
-	MemoryAccess dest = getMemory<M>();
-	registers.pc.w = dest.getAddress();
+	registers.pc.w = getAddress<M>();
 }
 
 void CPU::opJSR()
@@ -767,7 +1799,7 @@ void CPU::opJSR()
 template <MemoryAddressingMode M>
 void CPU::opLDA()
 {
-	MemoryAccess src = getMemory<M>();
+	uint8_t src = readOperand<M>();
 	setSign(src);
 	setZero(src);
 	registers.a = src;
@@ -776,7 +1808,7 @@ void CPU::opLDA()
 template <MemoryAddressingMode M>
 void CPU::opLDX()
 {
-	MemoryAccess src = getMemory<M>();
+	uint8_t src = readOperand<M>();
 	setSign(src);
 	setZero(src);
 	registers.x = src;
@@ -785,7 +1817,7 @@ void CPU::opLDX()
 template <MemoryAddressingMode M>
 void CPU::opLDY()
 {
-	MemoryAccess src = getMemory<M>();
+	uint8_t src = readOperand<M>();
 	setSign(src);
 	setZero(src);
 	registers.y = src;
@@ -794,16 +1826,18 @@ void CPU::opLDY()
 template <MemoryAddressingMode M>
 void CPU::opLSR()
 {
-	MemoryAccess src = getMemory<M>();
-	registers.p.sign = 0;
-	registers.p.carry = (src & BIT_0);
-	src = (src >> 1) & 0x7f;
-	setZero(src);
+	uint16_t address = getAddress<M>();
+	uint8_t value = readMemory<M>(address);
+	setSign(0);
+	registers.p.carry = (value & BIT_0);
+	value = (value >> 1) & 0x7f;
+	writeMemory<M>(address, value);
+	setZero(value);
 }
 
 void CPU::opLSRAccumulator()
 {
-	registers.p.sign = 0;
+	setSign(0);
 	registers.p.carry = (registers.a & BIT_0);
 	registers.a = (registers.a >> 1) & 0x7f;
 	setZero(registers.a);
@@ -817,7 +1851,7 @@ void CPU::opNOP()
 template <MemoryAddressingMode M>
 void CPU::opORA()
 {
-	MemoryAccess src = getMemory<M>();
+	uint8_t src = readOperand<M>();
 	registers.a |= src;
 	setSign(registers.a);
 	setZero(registers.a);
@@ -830,7 +1864,7 @@ void CPU::opPHA()
 
 void CPU::opPHP()
 {
-	push(registers.p.raw | 0x10);
+	push(registers.getP() | 0x10);
 }
 
 void CPU::opPLA()
@@ -842,22 +1876,24 @@ void CPU::opPLA()
 
 void CPU::opPLP()
 {
-	registers.p.raw = ((pull() & 0xef) | 0x20);
+	registers.setP((pull() & 0xef) | 0x20);
 }
 
 template <MemoryAddressingMode M>
 void CPU::opROL()
 {
-	MemoryAccess src = getMemory<M>();
-	bool bit7 = src & BIT_7;
-	src = src << 1;
+	uint16_t address = getAddress<M>();
+	uint8_t value = readMemory<M>(address);
+	bool bit7 = value & BIT_7;
+	value = value << 1;
 	if( registers.p.carry )
 	{
-		src = src | BIT_0;
+		value = value | BIT_0;
 	}
+	writeMemory<M>(address, value);
 	registers.p.carry = (bit7 ? 1 : 0);
-	setSign(src);
-	setZero(src);
+	setSign(value);
+	setZero(value);
 }
 
 void CPU::opROLAccumulator()
@@ -876,16 +1912,18 @@ void CPU::opROLAccumulator()
 template <MemoryAddressingMode M>
 void CPU::opROR()
 {
-	MemoryAccess src = getMemory<M>();
-	bool bit0 = src & BIT_0;
-	src = src >> 1;
+	uint16_t address = getAddress<M>();
+	uint8_t value = readMemory<M>(address);
+	bool bit0 = value & BIT_0;
+	value = value >> 1;
 	if( registers.p.carry )
 	{
-		src = src | BIT_7;
+		value = value | BIT_7;
 	}
+	writeMemory<M>(address, value);
 	registers.p.carry = (bit0 ? 1 : 0);
-	setSign(src);
-	setZero(src);
+	setSign(value);
+	setZero(value);
 }
 
 void CPU::opRORAccumulator()
@@ -903,7 +1941,7 @@ void CPU::opRORAccumulator()
 
 void CPU::opRTI()
 {
-	registers.p.raw = (pull() & 0xef) | 0x20;
+	registers.setP((pull() & 0xef) | 0x20);
 
 	uint16_t address = pull();
 	address |= ((uint16_t)pull() << 8);
@@ -920,11 +1958,11 @@ void CPU::opRTS()
 template <MemoryAddressingMode M>
 void CPU::opSBC()
 {
-	MemoryAccess src = getMemory<M>();
+	uint8_t src = readOperand<M>();
 	uint16_t temp = registers.a - src - (registers.p.carry ? 0 : 1);
 	setSign(temp);
 	setZero(temp & 0xff);
-	registers.p.overflow = (((registers.a ^ temp) & 0x80) && ((registers.a ^ src) & 0x80));
+	registers.overflowResult = (registers.a ^ temp) & (registers.a ^ src);
 	if( registers.p.decimal )
 	{
 		if( ((registers.a & 0xf) - (registers.p.carry ? 0 : 1)) < (src & 0xf))
@@ -953,22 +1991,19 @@ void CPU::opSEI()
 template <MemoryAddressingMode M>
 void CPU::opSTA()
 {
-	MemoryAccess dest = getMemory<M>();
-	dest = registers.a;
+	writeMemory<M>(getAddress<M>(), registers.a);
 }
 
 template <MemoryAddressingMode M>
 void CPU::opSTX()
 {
-	MemoryAccess dest = getMemory<M>();
-	dest = registers.x;
+	writeMemory<M>(getAddress<M>(), registers.x);
 }
 
 template <MemoryAddressingMode M>
 void CPU::opSTY()
 {
-	MemoryAccess dest = getMemory<M>();
-	dest = registers.y;
+	writeMemory<M>(getAddress<M>(), registers.y);
 }
 
 void CPU::opTAX()
@@ -3,7 +3,6 @@
 
 #include "Types.hpp"
 
-class MemoryAccess;
 class NES;
 
 /**
@@ -11,6 +10,8 @@ class NES;
  */
 enum MemoryAddressingMode
 {
+	MEM_IMPLIED,
+	MEM_ACCUMULATOR,
 	MEM_IMMEDIATE,
 
 	MEM_ABSOLUTE,
@@ -25,6 +26,16 @@ enum MemoryAddressingMode
 	MEM_RELATIVE
 };
 
+/**
+ * Ways the CPU can execute code.
+ */
+enum ExecutionMode
+{
+	EXECUTION_INTERPRETER, /**< Interpret one instruction at a time. */
+	EXECUTION_TRANSLATOR,  /**< Run translated blocks of PRG ROM code where possible. */
+	EXECUTION_VERIFY       /**< Run translated blocks and check them against the interpreter. */
+};
+
 /**
  * CPU registers.
  */
@@ -45,12 +56,38 @@ class CPU
 {
 public:
 	CPU( NES& nes );
+	~CPU();
 
 	/**
 	 * Request a Non-Maskable Interrupt (NMI) on the next instruction.
 	 */
 	void requestNMI();
 
+	/**
+	 * Run CPU emulation for up to a number of cycles.
+	 *
+	 * Translated blocks are only run while they fit in the cycle budget.
+	 * They never access I/O registers or the mapper. Any other instruction
+	 * is run alone by the interpreter, and ends the run, so that the caller
+	 * can pick up events that its register writes scheduled before running
+	 * more code. At least one instruction is always executed.
+	 *
+	 * @return the number of cycles taken to execute the instructions.
+	 */
+	int run( int cycleBudget );
+
+	/**
+	 * Select how the CPU executes code.
+	 */
+	void setExecutionMode( ExecutionMode mode );
+
+	/**
+	 * Set the state of the IRQ line. The line is level triggered: an IRQ
+	 * is taken before each instruction while it is asserted and interrupts
+	 * are enabled, until the device that asserted it releases it.
+	 */
+	void setIRQ( bool asserted );
+
 	/**
 	 * Step CPU emulation by one instruction.
 	 *
@@ -63,11 +100,6 @@ private:
 	// Types and classes used by the CPU
 	//*****************************************************************
 
-	/**
-	 * Type used for opcode handler functions.
-	 */
-	typedef void (CPU::*OpcodeHandler)(void);
-
 	/**
 	 * Interrupts handled by the CPU.
 	 */
@@ -78,6 +110,46 @@ private:
 		INTERRUPT_NMI
 	};
 
+	/**
+	 * An instruction decoded from PRG ROM.
+	 */
+	struct DecodedInstruction
+	{
+		uint8_t opcode;  /**< The opcode of the instruction. */
+		uint8_t length;  /**< Length of the instruction in bytes, or 0 if not decoded yet. */
+		Word    operand; /**< The operand bytes that follow the opcode. */
+	};
+
+	/**
+	 * Executes one opcode, whose operand has already been fetched.
+	 */
+	typedef void (*OpcodeHandler)( CPU& cpu );
+
+	/**
+	 * An instruction of a translated block, bound to the handler for its
+	 * opcode.
+	 */
+	struct ThreadedInstruction
+	{
+		OpcodeHandler handler; /**< The handler for the opcode. */
+		Word          operand; /**< The operand bytes that follow the opcode. */
+	};
+
+	/**
+	 * A straight-line block of PRG ROM instructions that can run without
+	 * synchronizing with the rest of the system. It is threaded code: the
+	 * instructions are run by calling their handlers one after another,
+	 * with no decoding or dispatch on the opcode.
+	 */
+	struct TranslatedBlock
+	{
+		int  cycles; /**< Total cycles taken by the block. */
+		int  length; /**< Number of instructions, or 0 if the code can't be translated. */
+		int  size;   /**< Size of the block's code in bytes. */
+		bool idle;   /**< Whether the block is a loop back to itself that never writes memory. */
+		ThreadedInstruction instructions[32];
+	};
+
 	/**
 	 * Contains all registers needed for the CPU.
 	 */
@@ -91,18 +163,37 @@ private:
 
 		/**
 		 * The status/flags register.
+		 *
+		 * The sign, zero and overflow flags are not stored here. They are
+		 * evaluated from the results below only when p is read as a whole.
 		 */
 		union
 		{
-			uint8_t raw;       /**< Raw value of the entire p register. */
+			uint8_t raw;       /**< Raw value of the stored flags. */
 			Bit<0>  carry;     /**< Carry. */
-			Bit<1>  zero;      /**< Zero. */
 			Bit<2>  interrupt; /**< Interrupt enable/disable. */
 			Bit<3>  decimal;   /**< Decimal mode. */
 			Bit<4>  brk;       /**< Break. */
-			Bit<6>  overflow;  /**< Overflow. */
-			Bit<7>  sign;      /**< Sign flag. */
 		} p;
+
+		uint8_t signResult;     /**< The sign flag is bit 7 of this value. */
+		uint8_t zeroResult;     /**< The zero flag is set when this value is 0. */
+		uint8_t overflowResult; /**< The overflow flag is bit 7 of this value. */
+
+		/**
+		 * Get the value of the p register with all flags evaluated.
+		 */
+		uint8_t getP() const;
+
+		/**
+		 * Set the value of the p register, including the lazily evaluated flags.
+		 */
+		void setP( uint8_t value );
+
+		/**
+		 * Check if all registers, including the evaluated flags, are equal.
+		 */
+		bool operator == ( const Registers& other ) const;
 	};
 
 	/**
@@ -126,19 +217,62 @@ private:
 	//*****************************************************************
 
 	NES& nes;
+	uint8_t* ram; /**< Internal RAM, for direct zero page and stack access. */
 	Registers registers;
 	Interrupt interrupt;
-	OpcodeHandler opcodes[0x100];
+	bool irqLine; /**< True while the IRQ line is asserted. */
+	Word operand; /**< Operand of the instruction currently being executed. */
+
+	DecodedInstruction* decodeCache; /**< Decoded PRG ROM instructions, indexed by ROM offset. */
+	TranslatedBlock** blockCache;    /**< Translated blocks, indexed by the ROM offset they start at. */
+	static OpcodeHandler opcodeHandlers[0x100]; /**< The handler for each opcode. */
+	ExecutionMode executionMode;
+	bool loopStart; /**< Whether the last jump went backwards, so the program counter may be at the start of a loop. */
 
 	//*****************************************************************
 	// Member functions
 	//*****************************************************************
 
+	/**
+	 * Check if an IRQ will be taken before the next instruction.
+	 */
+	bool isIRQPending() const;
+
+	/**
+	 * Decode the instruction at a PRG ROM address into the decode cache.
+	 */
+	void decode( DecodedInstruction& instruction, uint16_t address );
+
+	/**
+	 * Execute an opcode whose operand has already been fetched.
+	 *
+	 * @tparam Opcode uint8_t, or std::integral_constant for an opcode known
+	 * at compile time so that the dispatch folds away.
+	 */
+	template <typename Opcode>
+	void execute( Opcode opcode );
+
+	/**
+	 * The handler for an opcode, with the opcode's instruction expanded
+	 * in place.
+	 */
+	template <uint8_t Opcode>
+	static void executeOpcode( CPU& cpu );
+
+	/**
+	 * Fill the first entries of the opcode handler table.
+	 */
+	template <int Count>
+	static void fillOpcodeHandlers();
+
 	uint8_t getImmediate8();
 	uint16_t getImmediate16();
 
+	/**
+	 * Get the effective address of an instruction's memory operand.
+	 */
 	template <MemoryAddressingMode M>
-	MemoryAccess getMemory();
+	uint16_t getAddress();
 
 	template <Register R>
 	RegisterAccess<R> getRegister();
@@ -155,9 +289,56 @@ private:
 	 */
 	void push( uint8_t value );
 
+	/**
+	 * Read a byte of memory. Zero page is read directly from internal RAM.
+	 */
+	template <MemoryAddressingMode M>
+	uint8_t readMemory( uint16_t address );
+
+	/**
+	 * Read the value of an instruction's operand.
+	 */
+	template <MemoryAddressingMode M>
+	uint8_t readOperand();
+
+	/**
+	 * Run a translated block.
+	 *
+	 * @return the number of cycles taken to execute the block.
+	 */
+	int runBlock( const TranslatedBlock& block );
+
 	void setSign( uint8_t value );
 	void setZero( uint8_t value );
 
+	/**
+	 * Run one iteration of the loop at the program counter if it is an idle
+	 * loop or a loop that polls PPUSTATUS, then skip every later iteration
+	 * that fits in the cycle budget and is known to end in the same state.
+	 *
+	 * @return the number of cycles taken, or 0 if there is no such loop.
+	 */
+	int skipLoop( int cycleBudget );
+
+	/**
+	 * Translate the block of PRG ROM code starting at an address.
+	 */
+	TranslatedBlock* translate( uint16_t address );
+
+	/**
+	 * Run a translated block, then run the same code through the
+	 * interpreter and check that both produce the same state.
+	 *
+	 * @return the number of cycles taken to execute the block.
+	 */
+	int verifyBlock( const TranslatedBlock& block );
+
+	/**
+	 * Write a byte of memory. Zero page is written directly to internal RAM.
+	 */
+	template <MemoryAddressingMode M>
+	void writeMemory( uint16_t address, uint8_t value );
+
 	//*****************************************************************
 	// Opcode templates and methods
 	//*****************************************************************
@@ -221,6 +402,16 @@ private:
 	 */
 	void opBPL();
 
+	/**
+	 * BVC opcode.
+	 */
+	void opBVC();
+
+	/**
+	 * BVS opcode.
+	 */
+	void opBVS();
+
 	/**
 	 * CLC opcode.
 	 */
@@ -231,6 +422,11 @@ private:
 	 */
 	void opCLD();
 
+	/**
+	 * CLI opcode.
+	 */
+	void opCLI();
+
 	/**
 	 * CMP opcode template.
 	 */
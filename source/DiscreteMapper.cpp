@@ -0,0 +1,112 @@
+#include <iostream>
+
+#include "DiscreteMapper.hpp"
+#include "NES.hpp"
+
+DiscreteMapper::DiscreteMapper( NES& nes, const char* name ) :
+	nes(nes),
+	name(name),
+	chrRAM(nes.getMemory().getChrRAM()),
+	chr(nullptr),
+	mirroring(-1)
+{
+	prg[0] = nullptr;
+	prg[1] = nullptr;
+
+	selectPrg16(0x8000, 0);
+	selectPrg16(0xc000, nes.getROMImage().getHeader()->prgPages - 1);
+
+	// The PPU doesn't exist yet
+	selectChr8(0, false);
+}
+
+NametableMirrorMode DiscreteMapper::getInitialMirroring( NametableMirrorMode headerMode ) const
+{
+	if( mirroring < 0 )
+	{
+		return headerMode;
+	}
+
+	return (NametableMirrorMode)mirroring;
+}
+
+void DiscreteMapper::print() const
+{
+	const ROMHeader* header = nes.getROMImage().getHeader();
+
+	std::cout << "************************************************************************\n";
+	std::cout << "MAPPER INFORMATION\n";
+	std::cout << "Mapper:\t\t" << name << "\n";
+	std::cout << "PRG ROM:\t" << header->prgPages * 16 << "kb\n";
+	if( chrRAM != nullptr )
+	{
+		std::cout << "CHR RAM:\t8kb\n";
+	}
+	else
+	{
+		std::cout << "CHR ROM:\t" << header->chrPages * 8 << "kb\n";
+	}
+	std::cout << "************************************************************************\n";
+}
+
+uint8_t DiscreteMapper::readByte( uint16_t address )
+{
+	// PRG and CHR are read directly through the memory map, and there is
+	// no PRG RAM
+	return 0;
+}
+
+void DiscreteMapper::selectChr8( int bank, bool notify )
+{
+	// CHR RAM can't be switched, and is already mapped
+	if( chrRAM != nullptr )
+	{
+		return;
+	}
+
+	const uint8_t* page = nes.getROMImage().getChrPage(bank % nes.getROMImage().getHeader()->chrPages);
+	if( page == chr )
+	{
+		return;
+	}
+
+	if( notify )
+	{
+		nes.getPPU().prepareChrSwitch();
+	}
+	chr = page;
+	nes.getMemory().mapChrReadPages(0x0000, 0x2000, page);
+}
+
+void DiscreteMapper::selectMirroring( NametableMirrorMode mode, bool notify )
+{
+	if( mode == mirroring )
+	{
+		return;
+	}
+
+	mirroring = mode;
+	if( notify )
+	{
+		nes.getPPU().setMirroring(mode);
+	}
+}
+
+void DiscreteMapper::selectPrg16( uint16_t address, int bank )
+{
+	const uint8_t* page = nes.getROMImage().getPrgPage(bank % nes.getROMImage().getHeader()->prgPages);
+	int slot = (address >> 14) & 0x1;
+	if( page == prg[slot] )
+	{
+		return;
+	}
+
+	prg[slot] = page;
+	nes.getMemory().mapReadPages(0x8000 + slot * 0x4000, 0x4000, page);
+}
+
+void DiscreteMapper::selectPrg32( int bank )
+{
+	selectPrg16(0x8000, bank * 2);
+	selectPrg16(0xc000, bank * 2 + 1);
+}
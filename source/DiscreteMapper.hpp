@@ -0,0 +1,198 @@
+#ifndef DISCRETE_MAPPER_HPP
+#define DISCRETE_MAPPER_HPP
+
+#include "Mapper.hpp"
+#include "PPU.hpp"
+
+class NES;
+
+/**
+ * Base class for boards built from discrete logic, which switch PRG in
+ * 16kb or 32kb banks and CHR in 8kb banks.
+ *
+ * Selecting a bank only updates the pages mapped in Memory, and does
+ * nothing when the bank is already mapped. Selecting the mirroring that is
+ * already in use does nothing either.
+ */
+class DiscreteMapper : public Mapper
+{
+public:
+	/**
+	 * Map the first 16kb of PRG at $8000, the last 16kb at $c000 and the
+	 * first 8kb of CHR. Boards without CHR ROM get 8kb of CHR RAM.
+	 *
+	 * @param name the name of the board, for print().
+	 */
+	DiscreteMapper( NES& nes, const char* name );
+
+	NametableMirrorMode getInitialMirroring( NametableMirrorMode headerMode ) const;
+	void print() const;
+	uint8_t readByte( uint16_t address );
+
+protected:
+	/**
+	 * Read a byte of the PRG ROM mapped at $8000-$ffff.
+	 */
+	uint8_t readPrg( uint16_t address ) const;
+
+	/**
+	 * Map an 8kb CHR bank at $0000.
+	 *
+	 * @param notify true to let the PPU catch up before the bank is
+	 * switched. It doesn't exist yet when the mapper is constructed.
+	 */
+	void selectChr8( int bank, bool notify = true );
+
+	/**
+	 * Change how the nametables are mirrored.
+	 *
+	 * @param notify true to pass the change on to the PPU. It doesn't exist
+	 * yet when the mapper is constructed, and gets the mode from
+	 * getInitialMirroring() instead.
+	 */
+	void selectMirroring( NametableMirrorMode mode, bool notify = true );
+
+	/**
+	 * Map a 16kb PRG bank at $8000 or $c000.
+	 */
+	void selectPrg16( uint16_t address, int bank );
+
+	/**
+	 * Map a 32kb PRG bank at $8000.
+	 */
+	void selectPrg32( int bank );
+
+private:
+	NES& nes;
+	const char* name;
+
+	uint8_t* chrRAM;       /**< 8kb of CHR RAM for boards without CHR ROM, or nullptr. */
+	const uint8_t* prg[2]; /**< The 16kb PRG banks mapped at $8000 and $c000. */
+	const uint8_t* chr;    /**< The 8kb CHR bank mapped at $0000. */
+	int mirroring;         /**< The NametableMirrorMode selected by the board, or -1 if it is wired as the header says. */
+};
+
+inline uint8_t DiscreteMapper::readPrg( uint16_t address ) const
+{
+	return prg[(address >> 14) & 0x1][address & 0x3fff];
+}
+
+/**
+ * A discrete mapper with a single bank latch, written at $8000-$ffff.
+ *
+ * @tparam BusConflicts true if the ROM also drives the data bus during
+ * writes, so the latch gets the written value ANDed with the ROM byte at
+ * the same address.
+ */
+template <bool BusConflicts>
+class LatchMapper : public DiscreteMapper
+{
+public:
+	LatchMapper( NES& nes, const char* name ) :
+		DiscreteMapper(nes, name)
+	{
+	}
+
+	void writeByte( uint16_t address, uint8_t value )
+	{
+		if( address < 0x8000 )
+		{
+			return;
+		}
+
+		if( BusConflicts )
+		{
+			value &= readPrg(address);
+		}
+		writeLatch(value);
+	}
+
+protected:
+	/**
+	 * Switch banks for a value written to the latch.
+	 */
+	virtual void writeLatch( uint8_t value )=0;
+};
+
+/**
+ * iNES mapper 2: UxROM. 16kb PRG banks at $8000, with the last bank fixed
+ * at $c000. Usually has CHR RAM.
+ */
+class UxROM : public LatchMapper<true>
+{
+public:
+	UxROM( NES& nes ) : LatchMapper<true>(nes, "UxROM") {}
+
+protected:
+	void writeLatch( uint8_t value ) { selectPrg16(0x8000, value); }
+};
+
+/**
+ * iNES mapper 3: CNROM. Fixed PRG like NROM, with 8kb CHR banks.
+ */
+class CNROM : public LatchMapper<true>
+{
+public:
+	CNROM( NES& nes ) : LatchMapper<true>(nes, "CNROM") {}
+
+protected:
+	void writeLatch( uint8_t value ) { selectChr8(value); }
+};
+
+/**
+ * iNES mapper 7: AxROM. 32kb PRG banks and single screen mirroring
+ * selected by bit 4, starting with the lower page. Has CHR RAM.
+ */
+class AxROM : public LatchMapper<false>
+{
+public:
+	AxROM( NES& nes ) :
+		LatchMapper<false>(nes, "AxROM")
+	{
+		selectPrg32(0);
+		selectMirroring(MIRROR_SINGLE_LOWER, false);
+	}
+
+protected:
+	void writeLatch( uint8_t value )
+	{
+		selectPrg32(value & 0x07);
+		selectMirroring((value & BIT_4) ? MIRROR_SINGLE_UPPER : MIRROR_SINGLE_LOWER);
+	}
+};
+
+/**
+ * iNES mapper 11: Color Dreams. 32kb PRG banks in the low bits and 8kb CHR
+ * banks in the high bits.
+ */
+class ColorDreams : public LatchMapper<true>
+{
+public:
+	ColorDreams( NES& nes ) : LatchMapper<true>(nes, "Color Dreams") { selectPrg32(0); }
+
+protected:
+	void writeLatch( uint8_t value )
+	{
+		selectPrg32(value & 0x03);
+		selectChr8(value >> 4);
+	}
+};
+
+/**
+ * iNES mapper 66: GxROM. 32kb PRG banks in bits 4-5 and 8kb CHR banks in
+ * bits 0-1.
+ */
+class GxROM : public LatchMapper<true>
+{
+public:
+	GxROM( NES& nes ) : LatchMapper<true>(nes, "GxROM") { selectPrg32(0); }
+
+protected:
+	void writeLatch( uint8_t value )
+	{
+		selectPrg32((value >> 4) & 0x03);
+		selectChr8(value & 0x03);
+	}
+};
+
+#endif // DISCRETE_MAPPER_HPP
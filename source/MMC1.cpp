@@ -0,0 +1,195 @@
+#include <cstring>
+#include <iostream>
+
+#include "MMC1.hpp"
+#include "NES.hpp"
+
+/**
+ * The nametable mirroring selected by the low 2 bits of the control register.
+ */
+static const NametableMirrorMode mirrorModes[4] = {
+	MIRROR_SINGLE_LOWER,
+	MIRROR_SINGLE_UPPER,
+	MIRROR_VERTICAL,
+	MIRROR_HORIZONTAL
+};
+
+MMC1::MMC1( NES& nes ) :
+	nes(nes),
+	shift(0),
+	shiftCount(0),
+	control(0x0c),
+	chrBank0(0),
+	chrBank1(0),
+	prgBank(0),
+	chrRAM(nes.getMemory().getChrRAM())
+{
+	memset(prgRAM, 0, sizeof(prgRAM));
+	prg[0] = nullptr;
+	prg[1] = nullptr;
+	chr[0] = nullptr;
+	chr[1] = nullptr;
+
+	// The CPU and PPU don't exist yet, and start out with the initial banks anyway
+	mapBanks(false);
+}
+
+void MMC1::mapBanks( bool notify )
+{
+	Memory& memory = nes.getMemory();
+	const ROMHeader* header = nes.getROMImage().getHeader();
+
+	// CHR is switched in 4kb banks, or in pairs of them in 8kb mode
+	int chrBanks = (chrRAM != nullptr) ? 2 : header->chrPages * 2;
+	int chrSelect[2];
+	if( control & BIT_4 )
+	{
+		chrSelect[0] = chrBank0 % chrBanks;
+		chrSelect[1] = chrBank1 % chrBanks;
+	}
+	else
+	{
+		chrSelect[0] = (chrBank0 & 0x1e) % chrBanks;
+		chrSelect[1] = chrSelect[0] + 1;
+	}
+
+	const uint8_t* chrBase = (chrRAM != nullptr) ? chrRAM : nes.getROMImage().getChrPage(0);
+	if( chrBase + chrSelect[0] * 0x1000 != chr[0] || chrBase + chrSelect[1] * 0x1000 != chr[1] )
+	{
+		if( notify )
+		{
+			nes.getPPU().prepareChrSwitch();
+		}
+		for( int i = 0; i < 2; i++ )
+		{
+			chr[i] = chrBase + chrSelect[i] * 0x1000;
+			memory.mapChrReadPages(i * 0x1000, 0x1000, chr[i]);
+			if( chrRAM != nullptr )
+			{
+				memory.mapChrWritePages(i * 0x1000, 0x1000, chrRAM + chrSelect[i] * 0x1000);
+			}
+		}
+	}
+
+	// PRG is switched in 16kb banks. Boards with 512kb of PRG ROM use bit 4
+	// of the first CHR bank to select which 256kb the banks come from.
+	int prgBanks = header->prgPages;
+	int outer = (prgBanks > 16) ? (chrBank0 & 0x10) : 0;
+	int bank = (prgBank & 0x0f) | outer;
+	int prgSelect[2];
+	switch( (control >> 2) & 0x3 )
+	{
+	default:
+		// 32kb mode
+		prgSelect[0] = bank & ~1;
+		prgSelect[1] = bank | 1;
+		break;
+	case 2:
+		// First bank fixed at $8000
+		prgSelect[0] = outer;
+		prgSelect[1] = bank;
+		break;
+	case 3:
+		// Last bank fixed at $c000
+		prgSelect[0] = bank;
+		prgSelect[1] = outer | 0x0f;
+		break;
+	}
+
+	for( int i = 0; i < 2; i++ )
+	{
+		const uint8_t* page = nes.getROMImage().getPrgPage(prgSelect[i] % prgBanks);
+		if( page != prg[i] )
+		{
+			prg[i] = page;
+			memory.mapReadPages(0x8000 + i * 0x4000, 0x4000, page);
+		}
+	}
+
+	// PRG RAM is enabled while bit 4 of the PRG bank is clear
+	uint8_t* ram = (prgBank & BIT_4) ? nullptr : prgRAM;
+	memory.mapReadPages(0x6000, 0x2000, ram);
+	memory.mapWritePages(0x6000, 0x2000, ram);
+}
+
+void MMC1::print() const
+{
+	const ROMHeader* header = nes.getROMImage().getHeader();
+
+	std::cout << "************************************************************************\n";
+	std::cout << "MAPPER INFORMATION\n";
+	std::cout << "Mapper:\t\tMMC1\n";
+	std::cout << "PRG ROM:\t" << header->prgPages * 16 << "kb\n";
+	if( chrRAM != nullptr )
+	{
+		std::cout << "CHR RAM:\t8kb\n";
+	}
+	else
+	{
+		std::cout << "CHR ROM:\t" << header->chrPages * 8 << "kb\n";
+	}
+	std::cout << "************************************************************************\n";
+}
+
+uint8_t MMC1::readByte( uint16_t address )
+{
+	// ROM and RAM are read directly through the memory map, so this is
+	// only reached while PRG RAM is disabled
+	return 0;
+}
+
+void MMC1::writeByte( uint16_t address, uint8_t value )
+{
+	// The registers are at $8000-$ffff, and everything below that is
+	// either memory or unused
+	if( address < 0x8000 )
+	{
+		return;
+	}
+
+	// Writing a value with bit 7 set resets the shift register and fixes
+	// the last PRG bank at $c000
+	if( value & BIT_7 )
+	{
+		shift = 0;
+		shiftCount = 0;
+		writeRegister(0x8000, control | 0x0c);
+		return;
+	}
+
+	// The fifth write copies the shift register to the register selected
+	// by its address
+	shift |= (value & 0x1) << shiftCount;
+	shiftCount++;
+	if( shiftCount == 5 )
+	{
+		uint8_t data = shift;
+		shift = 0;
+		shiftCount = 0;
+		writeRegister(address, data);
+	}
+}
+
+void MMC1::writeRegister( uint16_t address, uint8_t value )
+{
+	switch( address & 0xe000 )
+	{
+	case 0x8000:
+		control = value;
+		nes.getPPU().setMirroring(mirrorModes[control & 0x3]);
+		break;
+	case 0xa000:
+		chrBank0 = value;
+		break;
+	case 0xc000:
+		chrBank1 = value;
+		break;
+	case 0xe000:
+		prgBank = value;
+		break;
+	default:
+		break;
+	}
+
+	mapBanks(true);
+}
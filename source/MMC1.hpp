@@ -0,0 +1,53 @@
+#ifndef MMC1_HPP
+#define MMC1_HPP
+
+#include "Mapper.hpp"
+
+class NES;
+
+/**
+ * iNES mapper 1: MMC1.
+ *
+ * Registers are written one bit at a time through a serial shift register.
+ * Bank switches only change the pages mapped in Memory, so reads cost the
+ * same as they do with NROM.
+ */
+class MMC1 : public Mapper
+{
+public:
+	MMC1( NES& nes );
+
+	void print() const;
+	uint8_t readByte( uint16_t address );
+	void writeByte( uint16_t address, uint8_t value );
+
+private:
+	NES& nes;
+
+	uint8_t shift;    /**< Bits written to the shift register so far, lowest bit first. */
+	int shiftCount;   /**< Number of bits written to the shift register. */
+	uint8_t control;  /**< Mirroring, PRG bank mode and CHR bank mode ($8000-$9fff). */
+	uint8_t chrBank0; /**< CHR bank for $0000, or for $0000-$1fff in 8kb mode ($a000-$bfff). */
+	uint8_t chrBank1; /**< CHR bank for $1000 in 4kb mode ($c000-$dfff). */
+	uint8_t prgBank;  /**< PRG bank, and PRG RAM disable in bit 4 ($e000-$ffff). */
+
+	uint8_t prgRAM[0x2000]; /**< 8kb of PRG RAM at $6000-$7fff. */
+	uint8_t* chrRAM;        /**< 8kb of CHR RAM for boards without CHR ROM, or nullptr. */
+	const uint8_t* prg[2];  /**< The 16kb PRG banks mapped at $8000 and $c000. */
+	const uint8_t* chr[2];  /**< The 4kb CHR banks mapped at $0000 and $1000. */
+
+	/**
+	 * Map the selected PRG and CHR banks and PRG RAM.
+	 *
+	 * @param notify true to let the PPU catch up before CHR banks are
+	 * switched. It doesn't exist yet when the mapper is constructed.
+	 */
+	void mapBanks( bool notify );
+
+	/**
+	 * Write a full 5 bit value to one of the registers.
+	 */
+	void writeRegister( uint16_t address, uint8_t value );
+};
+
+#endif // MMC1_HPP
@@ -0,0 +1,283 @@
+#include <cstring>
+#include <iostream>
+
+#include "MMC3.hpp"
+#include "NES.hpp"
+
+MMC3::MMC3( NES& nes ) :
+	nes(nes),
+	bankSelect(0),
+	prgRAMControl(0x80),
+	irqLatch(0),
+	irqCounter(0),
+	irqReload(false),
+	irqEnabled(false),
+	counterTime(nes.getScheduler().getClock()),
+	chrRAM(nes.getMemory().getChrRAM())
+{
+	// Start out with distinct banks, so the first mapBanks() maps all of them
+	static const uint8_t initialBanks[8] = { 0, 2, 4, 5, 6, 7, 0, 1 };
+	memcpy(bankRegisters, initialBanks, sizeof(bankRegisters));
+	memset(prgRAM, 0, sizeof(prgRAM));
+	for( int i = 0; i < 4; i++ )
+	{
+		prg[i] = nullptr;
+	}
+	for( int i = 0; i < 8; i++ )
+	{
+		chr[i] = nullptr;
+	}
+
+	// The CPU and PPU don't exist yet, and start out with the initial banks anyway
+	mapBanks(false);
+}
+
+void MMC3::beginPPUChange()
+{
+	// Count the rises that happened with the old pattern table setup
+	updateCounter(nes.getScheduler().getClock());
+}
+
+void MMC3::clockCounter()
+{
+	if( irqCounter == 0 || irqReload )
+	{
+		irqCounter = irqLatch;
+		irqReload = false;
+	}
+	else
+	{
+		irqCounter--;
+	}
+
+	if( irqCounter == 0 && irqEnabled )
+	{
+		nes.getCPU().setIRQ(true);
+	}
+}
+
+void MMC3::endPPUChange()
+{
+	predictIRQ();
+}
+
+void MMC3::handleEvent( SchedulerEvent event, int64_t time )
+{
+	switch( event )
+	{
+	case EVENT_MAPPER_IRQ:
+		updateCounter(time);
+		predictIRQ();
+		break;
+	default:
+		break;
+	}
+}
+
+void MMC3::mapBanks( bool notify )
+{
+	Memory& memory = nes.getMemory();
+	const ROMHeader* header = nes.getROMImage().getHeader();
+
+	// R0 and R1 select 2kb CHR banks and R2-R5 select 1kb banks. Bit 7 of
+	// the bank select swaps which half of the pattern tables each group is in.
+	int chrBanks = (chrRAM != nullptr) ? 8 : header->chrPages * 8;
+	int chrSelect[8] = {
+		bankRegisters[0] & 0xfe,
+		bankRegisters[0] | 1,
+		bankRegisters[1] & 0xfe,
+		bankRegisters[1] | 1,
+		bankRegisters[2],
+		bankRegisters[3],
+		bankRegisters[4],
+		bankRegisters[5]
+	};
+
+	const uint8_t* chrBase = (chrRAM != nullptr) ? chrRAM : nes.getROMImage().getChrPage(0);
+	int chrSwap = (bankSelect & BIT_7) ? 4 : 0;
+	bool chrChanged = false;
+	for( int i = 0; i < 8; i++ )
+	{
+		if( chrBase + (chrSelect[i ^ chrSwap] % chrBanks) * 0x400 != chr[i] )
+		{
+			chrChanged = true;
+		}
+	}
+
+	if( chrChanged )
+	{
+		if( notify )
+		{
+			nes.getPPU().prepareChrSwitch();
+		}
+		for( int i = 0; i < 8; i++ )
+		{
+			int bank = chrSelect[i ^ chrSwap] % chrBanks;
+			chr[i] = chrBase + bank * 0x400;
+			memory.mapChrReadPages(i * 0x400, 0x400, chr[i]);
+			if( chrRAM != nullptr )
+			{
+				memory.mapChrWritePages(i * 0x400, 0x400, chrRAM + bank * 0x400);
+			}
+		}
+	}
+
+	// R6 and R7 select 8kb PRG banks and the last bank is fixed at $e000.
+	// Bit 6 of the bank select swaps R6 with the second to last bank.
+	int prgBanks = header->prgPages * 2;
+	int prgSelect[4];
+	if( bankSelect & BIT_6 )
+	{
+		prgSelect[0] = prgBanks - 2;
+		prgSelect[2] = bankRegisters[6];
+	}
+	else
+	{
+		prgSelect[0] = bankRegisters[6];
+		prgSelect[2] = prgBanks - 2;
+	}
+	prgSelect[1] = bankRegisters[7];
+	prgSelect[3] = prgBanks - 1;
+
+	for( int i = 0; i < 4; i++ )
+	{
+		const uint8_t* page = nes.getROMImage().getPrgPage(0) + (prgSelect[i] % prgBanks) * 0x2000;
+		if( page != prg[i] )
+		{
+			prg[i] = page;
+			memory.mapReadPages(0x8000 + i * 0x2000, 0x2000, page);
+		}
+	}
+
+	// PRG RAM is enabled by bit 7 of the RAM control and write protected by bit 6
+	bool ramEnabled = (prgRAMControl & BIT_7) != 0;
+	bool ramWritable = ramEnabled && !(prgRAMControl & BIT_6);
+	memory.mapReadPages(0x6000, 0x2000, ramEnabled ? prgRAM : nullptr);
+	memory.mapWritePages(0x6000, 0x2000, ramWritable ? prgRAM : nullptr);
+}
+
+void MMC3::predictIRQ()
+{
+	Scheduler& scheduler = nes.getScheduler();
+	scheduler.cancel(EVENT_MAPPER_IRQ);
+	if( !irqEnabled )
+	{
+		return;
+	}
+
+	// The counter reaches 0 on the clock after a reload when the latch is
+	// 0, and otherwise after counting down from the latch or its current value
+	int clocks = (irqCounter == 0 || irqReload) ? irqLatch + 1 : irqCounter;
+
+	int64_t time = counterTime;
+	int64_t rise = INT64_MAX;
+	for( int i = 0; i < clocks; i++ )
+	{
+		rise = nes.getPPU().getNextA12Rise(time);
+		if( rise == INT64_MAX )
+		{
+			// The counter won't be clocked unless the PPU setup changes
+			return;
+		}
+		time = rise + 1;
+	}
+
+	scheduler.schedule(EVENT_MAPPER_IRQ, rise);
+}
+
+void MMC3::print() const
+{
+	const ROMHeader* header = nes.getROMImage().getHeader();
+
+	std::cout << "************************************************************************\n";
+	std::cout << "MAPPER INFORMATION\n";
+	std::cout << "Mapper:\t\tMMC3\n";
+	std::cout << "PRG ROM:\t" << header->prgPages * 16 << "kb\n";
+	if( chrRAM != nullptr )
+	{
+		std::cout << "CHR RAM:\t8kb\n";
+	}
+	else
+	{
+		std::cout << "CHR ROM:\t" << header->chrPages * 8 << "kb\n";
+	}
+	std::cout << "************************************************************************\n";
+}
+
+uint8_t MMC3::readByte( uint16_t address )
+{
+	// ROM and RAM are read directly through the memory map, so this is
+	// only reached while PRG RAM is disabled
+	return 0;
+}
+
+void MMC3::updateCounter( int64_t time )
+{
+	PPU& ppu = nes.getPPU();
+	for( int64_t rise = ppu.getNextA12Rise(counterTime); rise <= time; rise = ppu.getNextA12Rise(counterTime) )
+	{
+		clockCounter();
+		counterTime = rise + 1;
+	}
+	counterTime = time + 1;
+}
+
+void MMC3::writeByte( uint16_t address, uint8_t value )
+{
+	// The registers are at $8000-$ffff, and everything below that is
+	// either write protected PRG RAM or unused
+	if( address < 0x8000 )
+	{
+		return;
+	}
+
+	// Each pair of registers is mirrored across an 8kb range, with even
+	// and odd addresses selecting between them
+	switch( address & 0xe001 )
+	{
+	case 0x8000:
+		bankSelect = value;
+		mapBanks(true);
+		break;
+	case 0x8001:
+		bankRegisters[bankSelect & 0x7] = value;
+		mapBanks(true);
+		break;
+	case 0xa000:
+		// Boards with four-screen VRAM have fixed mirroring
+		if( !(nes.getROMImage().getHeader()->getMirroring() & BIT_1) )
+		{
+			nes.getPPU().setMirroring((value & BIT_0) ? MIRROR_HORIZONTAL : MIRROR_VERTICAL);
+		}
+		break;
+	case 0xa001:
+		prgRAMControl = value;
+		mapBanks(true);
+		break;
+	case 0xc000:
+		updateCounter(nes.getScheduler().getClock());
+		irqLatch = value;
+		predictIRQ();
+		break;
+	case 0xc001:
+		updateCounter(nes.getScheduler().getClock());
+		irqCounter = 0;
+		irqReload = true;
+		predictIRQ();
+		break;
+	case 0xe000:
+		// Disabling the IRQ also acknowledges one that is pending
+		updateCounter(nes.getScheduler().getClock());
+		irqEnabled = false;
+		nes.getCPU().setIRQ(false);
+		predictIRQ();
+		break;
+	case 0xe001:
+		updateCounter(nes.getScheduler().getClock());
+		irqEnabled = true;
+		predictIRQ();
+		break;
+	default:
+		break;
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef MMC3_HPP
+#define MMC3_HPP
+
+#include "Mapper.hpp"
+
+class NES;
+
+/**
+ * iNES mapper 4: MMC3.
+ *
+ * PRG is switched in 8kb banks and CHR in 1kb and 2kb banks. A scanline
+ * counter clocked by PPU address line A12 raises an IRQ when it reaches 0.
+ * Rather than watching every PPU fetch, the counter is brought up to date
+ * when its registers or the PPU's pattern table setup change, and the IRQ
+ * is scheduled as an event at the time it is predicted to happen.
+ */
+class MMC3 : public Mapper
+{
+public:
+	MMC3( NES& nes );
+
+	void print() const;
+	uint8_t readByte( uint16_t address );
+	void writeByte( uint16_t address, uint8_t value );
+	void handleEvent( SchedulerEvent event, int64_t time );
+	void beginPPUChange();
+	void endPPUChange();
+
+private:
+	NES& nes;
+
+	uint8_t bankSelect;       /**< The bank register to update, and the PRG and CHR bank modes ($8000). */
+	uint8_t bankRegisters[8]; /**< R0-R5 select CHR banks, R6 and R7 select PRG banks ($8001). */
+	uint8_t prgRAMControl;    /**< PRG RAM enable and write protect ($a001). */
+
+	uint8_t irqLatch;    /**< The value the counter is reloaded with ($c000). */
+	uint8_t irqCounter;  /**< The scanline counter. */
+	bool irqReload;      /**< True if the counter is reloaded on its next clock ($c001). */
+	bool irqEnabled;     /**< True if the counter reaching 0 raises an IRQ ($e000/$e001). */
+	int64_t counterTime; /**< The first master clock time whose A12 rises haven't clocked the counter yet. */
+
+	uint8_t prgRAM[0x2000]; /**< 8kb of PRG RAM at $6000-$7fff. */
+	uint8_t* chrRAM;        /**< 8kb of CHR RAM for boards without CHR ROM, or nullptr. */
+	const uint8_t* prg[4];  /**< The 8kb PRG banks mapped at $8000-$ffff. */
+	const uint8_t* chr[8];  /**< The 1kb CHR banks mapped at $0000-$1fff. */
+
+	/**
+	 * Clock the scanline counter once.
+	 */
+	void clockCounter();
+
+	/**
+	 * Map the selected PRG and CHR banks and PRG RAM.
+	 *
+	 * @param notify true to let the PPU catch up before CHR banks are
+	 * switched. It doesn't exist yet when the mapper is constructed.
+	 */
+	void mapBanks( bool notify );
+
+	/**
+	 * Schedule the IRQ for when the counter is predicted to reach 0.
+	 */
+	void predictIRQ();
+
+	/**
+	 * Clock the counter for each A12 rise up to a master clock time.
+	 */
+	void updateCounter( int64_t time );
+};
+
+#endif // MMC3_HPP
@@ -4,6 +4,7 @@
  */
 
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
 
 #include <SDL2/SDL.h>
@@ -13,6 +14,10 @@
 #include "NES.hpp"
 
 static uint8_t* romData = nullptr;
+static ExecutionMode executionMode = EXECUTION_INTERPRETER;
+static PPURenderMode renderMode = RENDER_SCANLINE;
+static bool backgroundCache = false;
+static int renderInterval = 1;
 
 /**
  * Cleanup all resources used by libraries for program exit.
@@ -73,6 +78,9 @@ static bool loadROM( const std::string& filename )
 static void mainLoop()
 {
 	NES nes(romData);
+	nes.getCPU().setExecutionMode(executionMode);
+	nes.getPPU().setRenderMode(renderMode);
+	nes.getPPU().setBackgroundCacheEnabled(backgroundCache);
 
 #if 0
 	DebugWindow patternTableWindow("Pattern Table", 256, 128, 2);
@@ -82,6 +90,9 @@ static void mainLoop()
 	DebugWindow mainWindow("NES", 256, 240, 3);
 
 	bool running = true;
+	bool exposed = true;
+	Uint32 frameTicks = SDL_GetTicks();
+	int frameCount = 0;
 	while( running )
 	{
 		// Check input events
@@ -99,6 +110,9 @@ static void mainLoop()
 				case SDL_WINDOWEVENT_CLOSE:
 					running = false;
 					break;
+				case SDL_WINDOWEVENT_EXPOSED:
+					exposed = true;
+					break;
 				default:
 					break;
 				}
@@ -117,8 +131,14 @@ static void mainLoop()
 		nes.getController1().setButtonState(BUTTON_LEFT, keys[SDL_SCANCODE_LEFT]);
 		nes.getController1().setButtonState(BUTTON_RIGHT, keys[SDL_SCANCODE_RIGHT]);
 
-		// Run a frame of emulation
-		nes.stepFrame();
+		// Run a frame of emulation, only drawing one of every renderInterval frames.
+		// Frames that aren't drawn aren't shown or waited for either.
+		bool render = (frameCount++ % renderInterval) == 0;
+		nes.stepFrame(render);
+		if( !render )
+		{
+			continue;
+		}
 
 		// Render
 #if 0
@@ -134,7 +154,23 @@ static void mainLoop()
 		paletteWindow.render(palette);
 		delete [] palette;
 #endif
-		mainWindow.render(nes.getPPU().getFrameBuffer());
+		// Frames that are the same as the last one don't need to be shown
+		// again, unless the window contents were lost
+		if( nes.getPPU().isFrameChanged() || exposed )
+		{
+			mainWindow.render(nes.getPPU().getFrameBuffer());
+			exposed = false;
+		}
+		else
+		{
+			// Nothing waited for vsync, so wait out the rest of the frame
+			Uint32 elapsed = SDL_GetTicks() - frameTicks;
+			if( elapsed < 16 )
+			{
+				SDL_Delay(16 - elapsed);
+			}
+		}
+		frameTicks = SDL_GetTicks();
 	}
 }
 
@@ -143,12 +179,48 @@ static void mainLoop()
  */
 int main( int argc, char** argv )
 {
-	if( argc != 2 )
+	if( argc < 2 )
 	{
 		std::cout << "Please specify a ROM file to load as the second argument.\n";
 		return -1;
 	}
 
+	// Select the CPU execution mode and PPU rendering pipeline
+	for( int i = 2; i < argc; i++ )
+	{
+		std::string option = argv[i];
+		if( option == "--translate" )
+		{
+			executionMode = EXECUTION_TRANSLATOR;
+		}
+		else if( option == "--verify" )
+		{
+			executionMode = EXECUTION_VERIFY;
+		}
+		else if( option == "--accurate-ppu" )
+		{
+			renderMode = RENDER_DOT;
+		}
+		else if( option == "--background-cache" )
+		{
+			backgroundCache = true;
+		}
+		else if( option == "--render-every" )
+		{
+			if( i + 1 >= argc || atoi(argv[i + 1]) <= 0 )
+			{
+				std::cout << "--render-every needs a number of frames greater than 0\n";
+				return -1;
+			}
+			renderInterval = atoi(argv[++i]);
+		}
+		else
+		{
+			std::cout << "Unknown option \"" << option << "\"\n";
+			return -1;
+		}
+	}
+
 	// Wrap everything in a try-catch
 	try
 	{
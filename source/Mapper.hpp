@@ -1,6 +1,8 @@
 #ifndef MAPPER_HPP
 #define MAPPER_HPP
 
+#include "PPU.hpp"
+#include "Scheduler.hpp"
 #include "Types.hpp"
 
 /**
@@ -23,6 +25,32 @@ public:
 	 * Write a byte to the mapper.
 	 */
 	virtual void writeByte( uint16_t address, uint8_t value )=0;
+
+	/**
+	 * Handle a timing event scheduled by the mapper.
+	 *
+	 * @param time the master clock time that the event was scheduled for.
+	 */
+	virtual void handleEvent( SchedulerEvent event, int64_t time ) {}
+
+	/**
+	 * Get the nametable mirroring that the board starts out with. The PPU
+	 * asks for it when it is created, which is after the mapper.
+	 *
+	 * @param headerMode the mirroring given by the ROM header.
+	 */
+	virtual NametableMirrorMode getInitialMirroring( NametableMirrorMode headerMode ) const { return headerMode; }
+
+	/**
+	 * Called by the PPU, after catching up, just before it changes which
+	 * pattern tables it fetches from or whether it is rendering.
+	 */
+	virtual void beginPPUChange() {}
+
+	/**
+	 * Called by the PPU just after the change announced by beginPPUChange().
+	 */
+	virtual void endPPUChange() {}
 };
 
 #endif // MAPPER_HPP
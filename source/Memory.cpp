@@ -1,56 +1,80 @@
+#include <cstring>
 #include <iostream>
 
+#include "DiscreteMapper.hpp"
 #include "Memory.hpp"
+#include "MMC1.hpp"
+#include "MMC3.hpp"
 #include "NES.hpp"
 #include "NROM.hpp"
 
 //*********************************************************************
-// MemoryAccess wrapper
+// Memory class
 //*********************************************************************
 
-MemoryAccess::MemoryAccess( Memory& memory, uint16_t address ) :
-	memory(memory),
-	address(address),
-	valueInitialized(false)
-{
-}
-
-uint16_t MemoryAccess::getAddress() const
+Memory::Memory( NES& nes ) :
+	nes(nes),
+	mapper(nullptr)
 {
-	return address;
-}
+	prgROM = nes.getROMImage().getPrgPage(0);
+	prgSize = nes.getROMImage().getHeader()->prgPages * 0x4000;
 
-MemoryAccess& MemoryAccess::operator = ( uint8_t value )
-{
-	memory.writeByte(address, value);
-	valueInitialized = false;
-	return *this;
-}
+	// RAM powers on in an unpredictable state; clear it so runs are repeatable
+	memset(ram, 0, sizeof(ram));
 
-MemoryAccess::operator uint8_t()
-{
-	if( !valueInitialized )
+	// Cartridges without CHR ROM have 8kb of CHR RAM instead
+	memset(chrRAM, 0, sizeof(chrRAM));
+	if( nes.getROMImage().getHeader()->chrPages == 0 )
 	{
-		value = memory.readByte(address);
-		valueInitialized = true;
+		chr = chrRAM;
+		chrSize = sizeof(chrRAM);
+	}
+	else
+	{
+		chr = nes.getROMImage().getChrPage(0);
+		chrSize = nes.getROMImage().getHeader()->chrPages * 0x2000;
 	}
-	return value;
-}
 
-//*********************************************************************
-// Memory class
-//*********************************************************************
+	// Everything is handled by readRegister() and writeRegister() until mapped
+	mapReadPages(0x0000, 0x10000, nullptr);
+	mapWritePages(0x0000, 0x10000, nullptr);
+	mapChrReadPages(0x0000, 0x2000, getChrRAM());
+	mapChrWritePages(0x0000, 0x2000, getChrRAM());
 
-Memory::Memory( NES& nes ) :
-	nes(nes),
-	mapper(nullptr)
-{
-	// Create the mapper
+	// RAM is mirrored every 2kb up to $2000
+	for( uint16_t address = 0x0000; address < 0x2000; address += 0x800 )
+	{
+		mapReadPages(address, 0x800, ram);
+		mapWritePages(address, 0x800, ram);
+	}
+
+	// Create the mapper, which maps its own memory
 	switch( nes.getROMImage().getHeader()->getMapper() )
 	{
 	case 0:
 		mapper = new NROM(nes);
 		break;
+	case 1:
+		mapper = new MMC1(nes);
+		break;
+	case 2:
+		mapper = new UxROM(nes);
+		break;
+	case 3:
+		mapper = new CNROM(nes);
+		break;
+	case 4:
+		mapper = new MMC3(nes);
+		break;
+	case 7:
+		mapper = new AxROM(nes);
+		break;
+	case 11:
+		mapper = new ColorDreams(nes);
+		break;
+	case 66:
+		mapper = new GxROM(nes);
+		break;
 	default:
 		std::cout << "Error: unimplemented mapper number: " << (uint16_t)nes.getROMImage().getHeader()->getMapper() << std::endl;
 		exit(-1);
@@ -63,15 +87,78 @@ Mapper& Memory::getMapper()
 	return *mapper;
 }
 
-uint8_t Memory::readByte( uint16_t address )
+int Memory::getChrSize() const
+{
+	return chrSize;
+}
+
+uint8_t* Memory::getChrRAM()
+{
+	return (chr == chrRAM) ? chrRAM : nullptr;
+}
+
+int Memory::getPrgSize() const
 {
-	// RAM and Mirrors
-	if( address < 0x2000 )
+	return prgSize;
+}
+
+uint8_t* Memory::getRAM()
+{
+	return ram;
+}
+
+void Memory::mapReadPages( uint16_t address, int size, const uint8_t* data )
+{
+	for( int offset = 0; offset < size; offset += 0x800 )
+	{
+		int page = (address + offset) >> 11;
+		readPages[page] = (data == nullptr) ? nullptr : data + offset;
+
+		// Note where the page is in PRG ROM, if that is what it maps
+		prgOffsets[page] = -1;
+		if( data != nullptr && data + offset >= prgROM && data + offset < prgROM + prgSize )
+		{
+			prgOffsets[page] = (data + offset) - prgROM;
+		}
+	}
+}
+
+void Memory::mapWritePages( uint16_t address, int size, uint8_t* data )
+{
+	for( int offset = 0; offset < size; offset += 0x800 )
+	{
+		writePages[(address + offset) >> 11] = (data == nullptr) ? nullptr : data + offset;
+	}
+}
+
+void Memory::mapChrReadPages( uint16_t address, int size, const uint8_t* data )
+{
+	for( int offset = 0; offset < size; offset += 0x400 )
 	{
-		return ram[address & 0x7ff];
+		int page = (address + offset) >> 10;
+		chrReadPages[page] = (data == nullptr) ? nullptr : data + offset;
+
+		// Note where the page is in CHR memory, if that is what it maps
+		chrOffsets[page] = -1;
+		if( data != nullptr && data + offset >= chr && data + offset < chr + chrSize )
+		{
+			chrOffsets[page] = (data + offset) - chr;
+		}
+	}
+}
+
+void Memory::mapChrWritePages( uint16_t address, int size, uint8_t* data )
+{
+	for( int offset = 0; offset < size; offset += 0x400 )
+	{
+		chrWritePages[(address + offset) >> 10] = (data == nullptr) ? nullptr : data + offset;
 	}
+}
+
+uint8_t Memory::readRegister( uint16_t address )
+{
 	// PPU Registers and Mirrors
-	else if( address < 0x4000 )
+	if( address < 0x4000 )
 	{
 		return nes.getPPU().readRegister(0x2000 + (address & 0x7));
 	}
@@ -104,15 +191,10 @@ uint16_t Memory::readWord( uint16_t address )
 	return (uint16_t)readByte(address) | ((uint16_t)readByte(address + 1) << 8);
 }
 
-void Memory::writeByte( uint16_t address, uint8_t value )
+void Memory::writeRegister( uint16_t address, uint8_t value )
 {
-	// RAM and Mirrors
-	if( address < 0x2000 )
-	{
-		ram[address & 0x7ff] = value;
-	}
 	// PPU Registers and Mirrors
-	else if( address < 0x4000 )
+	if( address < 0x4000 )
 	{
 		nes.getPPU().writeRegister(0x2000 + (address & 0x7), value);
 	}
@@ -162,3 +244,13 @@ void Memory::writeByte( uint16_t address, uint8_t value )
 		mapper->writeByte(address, value);
 	}
 }
+
+uint8_t Memory::readUnmappedChr( uint16_t address )
+{
+	return mapper->readByte(address);
+}
+
+void Memory::writeUnmappedChr( uint16_t address, uint8_t value )
+{
+	mapper->writeByte(address, value);
+}
@@ -15,35 +15,221 @@ public:
 	Memory( NES& nes );
 
 	Mapper& getMapper();
+
+	/**
+	 * Get the 8kb of CHR RAM, or nullptr if the cartridge has CHR ROM
+	 * instead. CHR RAM starts out mapped to all of the pattern tables.
+	 */
+	uint8_t* getChrRAM();
+
+	/**
+	 * Get the 2kb of internal RAM.
+	 */
+	uint8_t* getRAM();
+
+	/**
+	 * Map a range of the CPU address space to memory that is read directly.
+	 * Mappers call this when they switch PRG banks.
+	 *
+	 * @param address the start of the range, a multiple of the 2kb page size.
+	 * @param size the size of the range, a multiple of the 2kb page size.
+	 * @param data the memory to read, or nullptr to read through the mapper.
+	 */
+	void mapReadPages( uint16_t address, int size, const uint8_t* data );
+
+	/**
+	 * Map a range of the CPU address space to memory that is written directly.
+	 *
+	 * @param address the start of the range, a multiple of the 2kb page size.
+	 * @param size the size of the range, a multiple of the 2kb page size.
+	 * @param data the memory to write, or nullptr to write through the mapper.
+	 */
+	void mapWritePages( uint16_t address, int size, uint8_t* data );
+
+	/**
+	 * Map a range of the PPU pattern tables ($0000-$1fff) to CHR memory
+	 * that is read directly. Mappers call this when they switch CHR banks.
+	 *
+	 * @param address the start of the range, a multiple of the 1kb page size.
+	 * @param size the size of the range, a multiple of the 1kb page size.
+	 * @param data the memory to read, or nullptr to read through the mapper.
+	 */
+	void mapChrReadPages( uint16_t address, int size, const uint8_t* data );
+
+	/**
+	 * Map a range of the PPU pattern tables to CHR RAM that is written directly.
+	 *
+	 * @param address the start of the range, a multiple of the 1kb page size.
+	 * @param size the size of the range, a multiple of the 1kb page size.
+	 * @param data the memory to write, or nullptr to write through the mapper.
+	 */
+	void mapChrWritePages( uint16_t address, int size, uint8_t* data );
+
+	/**
+	 * Get the offset in PRG ROM that a range of addresses is read from. The
+	 * CPU uses this to key the code it has decoded by ROM contents rather
+	 * than by address, so that it stays valid across bank switches.
+	 *
+	 * @param size the size of the range, up to the 2kb page size.
+	 * @return the offset, or -1 if the range isn't read contiguously from
+	 * PRG ROM.
+	 */
+	int getPrgOffset( uint16_t address, int size ) const;
+
+	/**
+	 * Get the size of PRG ROM in bytes.
+	 */
+	int getPrgSize() const;
+
+	/**
+	 * Get the offset in CHR ROM, or in CHR RAM for cartridges without CHR
+	 * ROM, that a pattern table address is read from. The PPU keys its
+	 * decoded tiles by this offset, so that they survive bank switches.
+	 *
+	 * @return the offset, or -1 if the address is read through the mapper.
+	 */
+	int getChrOffset( uint16_t address ) const;
+
+	/**
+	 * Get the size of CHR ROM, or CHR RAM for cartridges without CHR ROM,
+	 * in bytes.
+	 */
+	int getChrSize() const;
+
 	uint8_t readByte( uint16_t address );
 	uint16_t readWord( uint16_t address );
 	void writeByte( uint16_t address, uint8_t value );
 
+	/**
+	 * Read a byte of CHR memory for the PPU.
+	 */
+	uint8_t readChrByte( uint16_t address );
+
+	/**
+	 * Write a byte of CHR memory for the PPU.
+	 */
+	void writeChrByte( uint16_t address, uint8_t value );
+
 private:
 	NES& nes;
 	Mapper* mapper;
 
 	uint8_t ram[0x800]; /**< Internal RAM (2kb). */
+
+	const uint8_t* prgROM; /**< The start of PRG ROM. */
+	int prgSize;           /**< The size of PRG ROM in bytes. */
+
+	uint8_t chrRAM[0x2000]; /**< CHR RAM, used by cartridges without CHR ROM. */
+	const uint8_t* chr;     /**< The start of CHR ROM, or CHR RAM if there is no CHR ROM. */
+	int chrSize;            /**< The size of CHR ROM or RAM in bytes. */
+
+	const uint8_t* readPages[32];   /**< Memory that each 2kb page of the address space is read from, or nullptr to use readRegister(). */
+	uint8_t* writePages[32];        /**< Memory that each 2kb page of the address space is written to, or nullptr to use writeRegister(). */
+	int prgOffsets[32];             /**< Offset in PRG ROM that each 2kb page of the address space is read from, or -1 if it isn't PRG ROM. */
+	const uint8_t* chrReadPages[8]; /**< CHR memory that each 1kb page of the pattern tables is read from, or nullptr to use the mapper. */
+	uint8_t* chrWritePages[8];      /**< CHR memory that each 1kb page of the pattern tables is written to, or nullptr to use the mapper. */
+	int chrOffsets[8];              /**< Offset in CHR memory that each 1kb page of the pattern tables is read from, or -1 if it is read through the mapper. */
+
+	/**
+	 * Read from an address that isn't mapped to memory: I/O registers and
+	 * cartridge space that the mapper handles itself.
+	 */
+	uint8_t readRegister( uint16_t address );
+
+	/**
+	 * Write to an address that isn't mapped to memory.
+	 */
+	void writeRegister( uint16_t address, uint8_t value );
+
+	/**
+	 * Read CHR memory that isn't mapped, through the mapper.
+	 */
+	uint8_t readUnmappedChr( uint16_t address );
+
+	/**
+	 * Write CHR memory that isn't mapped, through the mapper.
+	 */
+	void writeUnmappedChr( uint16_t address, uint8_t value );
 };
 
-/**
- * Wraps individual byte memory access.
- */
-class MemoryAccess
+// Memory accesses are defined here so that they inline into the CPU and
+// PPU, leaving only unmapped accesses to go through a function call
+
+inline uint8_t Memory::readByte( uint16_t address )
 {
-public:
-	MemoryAccess( Memory& memory, uint16_t address );
+	const uint8_t* page = readPages[address >> 11];
+	if( page != nullptr )
+	{
+		return page[address & 0x7ff];
+	}
 
-	uint16_t getAddress() const;
+	return readRegister(address);
+}
 
-	MemoryAccess& operator = ( uint8_t value );
-	operator uint8_t();
+inline int Memory::getPrgOffset( uint16_t address, int size ) const
+{
+	int offset = prgOffsets[address >> 11];
+	if( offset < 0 )
+	{
+		return -1;
+	}
 
-private:
-	Memory& memory;
-	uint16_t address;
-	uint8_t value;
-	bool valueInitialized;
-};
+	// A range that runs into the next page is only contiguous if that page
+	// follows this one in PRG ROM
+	if( (address & 0x7ff) + size > 0x800 && prgOffsets[(uint16_t)(address + 0x800) >> 11] != offset + 0x800 )
+	{
+		return -1;
+	}
+
+	return offset + (address & 0x7ff);
+}
+
+inline int Memory::getChrOffset( uint16_t address ) const
+{
+	int offset = chrOffsets[address >> 10];
+	if( offset < 0 )
+	{
+		return -1;
+	}
+
+	return offset + (address & 0x3ff);
+}
+
+inline void Memory::writeByte( uint16_t address, uint8_t value )
+{
+	uint8_t* page = writePages[address >> 11];
+	if( page != nullptr )
+	{
+		page[address & 0x7ff] = value;
+	}
+	else
+	{
+		writeRegister(address, value);
+	}
+}
+
+inline uint8_t Memory::readChrByte( uint16_t address )
+{
+	const uint8_t* page = chrReadPages[address >> 10];
+	if( page != nullptr )
+	{
+		return page[address & 0x3ff];
+	}
+
+	return readUnmappedChr(address);
+}
+
+inline void Memory::writeChrByte( uint16_t address, uint8_t value )
+{
+	uint8_t* page = chrWritePages[address >> 10];
+	if( page != nullptr )
+	{
+		page[address & 0x3ff] = value;
+	}
+	else
+	{
+		writeUnmappedChr(address, value);
+	}
+}
 
 #endif // MEMORY_HPP
@@ -3,6 +3,7 @@
 
 NES::NES( uint8_t* romData ) :
 	romImage(romData),
+	scheduler(),
 	memory(*this),
 	cpu(*this),
 	ppu(*this)
@@ -46,19 +47,47 @@ ROMImage& NES::getROMImage()
 	return romImage;
 }
 
-void NES::stepFrame()
+Scheduler& NES::getScheduler()
 {
+	return scheduler;
+}
+
+void NES::stepFrame( bool render )
+{
+	ppu.setFrameSkipped(!render);
+
 	int startFrame = ppu.getFrame();
 	while( startFrame == ppu.getFrame() )
 	{
-		// Step the CPU
-		int cpuCycles = cpu.step();
+		// Run the CPU until it reaches the next event. Translated code may
+		// run ahead as long as it stops before the event. The next event is
+		// looked up again for every run, since a register write during the
+		// last one may have scheduled an earlier event.
+		while( scheduler.getClock() < scheduler.getNextEventTime() )
+		{
+			int cpuCycles = cpu.run((scheduler.getNextEventTime() - scheduler.getClock() - 1) / 3);
+			scheduler.advance(3 * cpuCycles);
+		}
 
-		// Step the PPU
-		int ppuCycles = 3 * cpuCycles;
-		for( int i = 0; i < ppuCycles; i++ )
+		// Handle every event that is due
+		while( scheduler.getNextEventTime() <= scheduler.getClock() )
 		{
-			ppu.step();
+			SchedulerEvent event = scheduler.getNextEvent();
+			int64_t time = scheduler.getNextEventTime();
+			scheduler.cancel(event);
+			switch( event )
+			{
+			case EVENT_VBLANK:
+			case EVENT_FRAME_END:
+			case EVENT_SPRITE_ZERO_HIT:
+				ppu.handleEvent(event, time);
+				break;
+			case EVENT_MAPPER_IRQ:
+				memory.getMapper().handleEvent(event, time);
+				break;
+			default:
+				break;
+			}
 		}
 	}
 }
@@ -7,6 +7,7 @@
 #include "Memory.hpp"
 #include "PPU.hpp"
 #include "ROMImage.hpp"
+#include "Scheduler.hpp"
 
 /**
  * Interface for all NES emulation.
@@ -23,14 +24,20 @@ public:
 	Memory& getMemory();
 	PPU& getPPU();
 	ROMImage& getROMImage();
+	Scheduler& getScheduler();
 
 	/**
 	 * Step a single frame of emulation.
+	 *
+	 * @param render false to skip drawing the frame, which is faster.
+	 * Emulation is otherwise the same, and the PPU keeps the last frame
+	 * that was drawn.
 	 */
-	void stepFrame();
+	void stepFrame( bool render = true );
 
 private:
 	ROMImage romImage;
+	Scheduler scheduler;
 	Memory memory;
 	CPU cpu;
 	PPU ppu;
@@ -12,6 +12,18 @@ NROM::NROM(NES& nes) :
 	{
 		nrom256 = true;
 	}
+
+	// If we are NROM-256, use the upper 16k of ROM at $c000, otherwise
+	// mirror the lower 16k of ROM
+	Memory& memory = nes.getMemory();
+	memory.mapReadPages(0x8000, 0x4000, nes.getROMImage().getPrgPage(0));
+	memory.mapReadPages(0xc000, 0x4000, nes.getROMImage().getPrgPage(nrom256 ? 1 : 0));
+
+	// Boards without CHR ROM use the CHR RAM that is already mapped
+	if( nes.getROMImage().getHeader()->chrPages > 0 )
+	{
+		memory.mapChrReadPages(0x0000, 0x2000, nes.getROMImage().getChrPage(0));
+	}
 }
 
 void NROM::print() const
@@ -25,29 +37,7 @@ void NROM::print() const
 
 uint8_t NROM::readByte( uint16_t address )
 {
-	if( address < 0x2000 )
-	{
-		// CHR
-		return nes.getROMImage().getChrPage(0)[address];
-	}
-	else if( address >= 0x8000 && address <= 0xbfff )
-	{
-		return (nes.getROMImage().getPrgPage(0))[address - 0x8000];
-	}
-	else if( address >= 0xc000 )
-	{
-		// If we are NROM-256, use the upper 16k of ROM, otherwise
-		// mirror the lower 16k of ROM
-		if( nrom256 )
-		{
-			return (nes.getROMImage().getPrgPage(1))[address - 0xc000];
-		}
-		else
-		{
-			return (nes.getROMImage().getPrgPage(0))[address - 0xc000];
-		}
-	}
-
+	// PRG and CHR ROM are read directly through the memory map
 	return 0;
 }
 
@@ -1,12 +1,21 @@
+#include <cstring>
 #include <iostream>
 
 #include "Mapper.hpp"
 #include "NES.hpp"
+#include "PixelKernels.hpp"
 #include "PPU.hpp"
 
+/**
+ * The nametable memory page used by each logical nametable, for each
+ * mirroring mode.
+ */
 static const uint8_t nametableMirrorLookup[][4] = {
-	{0, 0, 1, 1}, // Vertical
-	{0, 1, 0, 1}  // Horizontal
+	{0, 0, 1, 1}, // Horizontal
+	{0, 1, 0, 1}, // Vertical
+	{0, 0, 0, 0}, // Single screen, lower page
+	{1, 1, 1, 1}, // Single screen, upper page
+	{0, 1, 2, 3}  // Four-screen
 };
 
 /**
@@ -79,27 +88,273 @@ static const uint32_t paletteRGB[] = {
 	0x000000
 };
 
+/**
+ * Palette address of each pixel value of each background palette. Pixel
+ * value 0 is transparent and always uses the backdrop color at address 0.
+ */
+static const uint8_t backgroundPaletteAddresses[4][4] = {
+	{0, 0x01, 0x02, 0x03},
+	{0, 0x05, 0x06, 0x07},
+	{0, 0x09, 0x0a, 0x0b},
+	{0, 0x0d, 0x0e, 0x0f}
+};
+
 PPU::PPU(NES& nes) :
 	nes(nes)
 {
+	registers.PPUCTRL.raw = 0;
+	registers.PPUMASK.raw = 0;
+	registers.PPUSTATUS.raw = 0;
+	oamAddress = 0;
+
 	currentAddress.w = 0;
+	tempAddress.w = 0;
+	fineX = 0;
 	writeToggle = false;
 
 	///@todo what is the correct state for these at power-on?
+	// Start on the pre-render scanline (261)
 	frame = 0;
-	//scanline = 240;
-	//cycle = 340;
 	scanline = 261;
 	cycle = 0;
+	time = nes.getScheduler().getClock();
+	frameStart = time - 261 * 341;
+	nes.getScheduler().schedule(EVENT_VBLANK, frameStart + 262 * 341 + 241 * 341 + 1);
+	nes.getScheduler().schedule(EVENT_FRAME_END, frameStart + 262 * 341);
+
+	framebuffer[0] = new uint8_t[256 * 240];
+	framebuffer[1] = new uint8_t[256 * 240];
+	argbFramebuffer = new uint32_t[256 * 240];
+	drawBuffer = 0;
+	skipRendering = false;
+	argbFrame = -1;
+	changedFrame = -1;
+	frameChanged = false;
+	contentVersion = 1;
+	chrVersion = 0;
+	memset(lineState, 0, sizeof(lineState));
+	for( int emphasis = 0; emphasis < 8; emphasis++ )
+	{
+		for( int i = 0; i < 64; i++ )
+		{
+			int red   = (paletteRGB[i] >> 16) & 0xff;
+			int green = (paletteRGB[i] >> 8) & 0xff;
+			int blue  = paletteRGB[i] & 0xff;
+
+			// Each emphasis bit darkens the other two color channels
+			if( emphasis & 0x1 )
+			{
+				green = green * 3 / 4;
+				blue = blue * 3 / 4;
+			}
+			if( emphasis & 0x2 )
+			{
+				red = red * 3 / 4;
+				blue = blue * 3 / 4;
+			}
+			if( emphasis & 0x4 )
+			{
+				red = red * 3 / 4;
+				green = green * 3 / 4;
+			}
+			argbColors[emphasis][i] = 0xff000000 | (red << 16) | (green << 8) | blue;
+		}
+	}
+	memset(lineEmphasis, 0, sizeof(lineEmphasis));
+	memset(palette, 0, sizeof(palette));
+	resolvePalette();
+	memset(nametable, 0, sizeof(nametable));
+	memset(attributes, 0, sizeof(attributes));
+	memset(oam, 0, sizeof(oam));
+	int tileCount = nes.getMemory().getChrSize() / 16;
+	tileCache = new uint64_t[tileCount * 8];
+	tileCacheValid = new bool[tileCount];
+	memset(tileCacheValid, 0, tileCount);
+	tileStamps = new uint32_t[tileCount];
+	for( int tile = 0; tile < tileCount; tile++ )
+	{
+		tileStamps[tile] = tile + 1;
+	}
+	nextTileStamp = tileCount + 1;
+	backgroundCache = new uint8_t[4 * 256 * 240];
+	backgroundCacheEnabled = false;
+	memset(backgroundCacheStamps, 0, sizeof(backgroundCacheStamps));
+	renderMode = RENDER_SCANLINE;
+
+	nextTile = 0;
+	nextAttribute = 0;
+	nextPatternLow = 0;
+	nextPatternHigh = 0;
+	patternShiftLow = 0;
+	patternShiftHigh = 0;
+	attributeShiftLow = 0;
+	attributeShiftHigh = 0;
 
-	framebuffer[0] = new uint32_t[256 * 240];
-	framebuffer[1] = new uint32_t[256 * 240];
+	spriteCount = 0;
+	spriteZeroOnLine = false;
+	spriteZeroHitTime = INT64_MAX;
+	spriteZeroHitStale = false;
+
+	// Cartridges with four-screen VRAM set bit 1 of the header's mirroring mode
+	uint8_t mirroring = nes.getROMImage().getHeader()->getMirroring();
+	NametableMirrorMode headerMode = (mirroring & BIT_1) ? MIRROR_FOUR_SCREEN : (NametableMirrorMode)mirroring;
+	setMirroring(nes.getMemory().getMapper().getInitialMirroring(headerMode));
 }
 
 PPU::~PPU()
 {
 	delete [] framebuffer[0];
 	delete [] framebuffer[1];
+	delete [] argbFramebuffer;
+	delete [] tileCache;
+	delete [] tileCacheValid;
+	delete [] tileStamps;
+	delete [] backgroundCache;
+}
+
+void PPU::catchUp()
+{
+	runUntil(nes.getScheduler().getClock());
+}
+
+uint64_t PPU::decodeTileRow( uint16_t address )
+{
+	Memory& memory = nes.getMemory();
+	uint8_t plane1 = memory.readChrByte(address);
+	uint8_t plane2 = memory.readChrByte(address + 8);
+
+	uint64_t pixels = 0;
+	for( int column = 0; column < 8; column++ )
+	{
+		int bit = 7 - column;
+		uint64_t value = ((plane1 >> bit) & 1) | (((plane2 >> bit) & 1) << 1);
+		pixels |= value << (column * 8);
+	}
+	return pixels;
+}
+
+void PPU::evaluateSprites()
+{
+	int height = registers.PPUCTRL.spriteHeight ? 16 : 8;
+
+	spriteCount = 0;
+	spriteZeroOnLine = false;
+	for( int i = 0; i < 64; i++ )
+	{
+		// Sprites are drawn one line below their Y coordinate, so the sprites
+		// in range of this scanline are the ones on the next
+		int row = scanline - oam[i * 4];
+		if( row < 0 || row >= height )
+		{
+			continue;
+		}
+
+		if( spriteCount == 8 )
+		{
+			registers.PPUSTATUS.spriteOverflow = 1;
+			break;
+		}
+
+		uint8_t index      = oam[i * 4 + 1];
+		uint8_t attributes = oam[i * 4 + 2];
+
+		if( attributes & BIT_7 )
+		{
+			row = height - 1 - row;
+		}
+
+		// Determine the pattern table address of the sprite row
+		uint16_t address;
+		if( height == 16 )
+		{
+			address = ((index & 0x01) << 12) | ((index & 0xfe) << 4);
+			if( row >= 8 )
+			{
+				address += 16;
+				row -= 8;
+			}
+		}
+		else
+		{
+			address = (registers.PPUCTRL.spriteTile ? 0x1000 : 0) | (index << 4);
+		}
+
+		uint8_t low  = readByte(address + row);
+		uint8_t high = readByte(address + row + 8);
+
+		// Reverse the bits for horizontally flipped sprites, so the shift
+		// registers always output from the high bit
+		if( attributes & BIT_6 )
+		{
+			uint8_t flippedLow = 0;
+			uint8_t flippedHigh = 0;
+			for( int bit = 0; bit < 8; bit++ )
+			{
+				flippedLow  |= ((low  >> bit) & 1) << (7 - bit);
+				flippedHigh |= ((high >> bit) & 1) << (7 - bit);
+			}
+			low = flippedLow;
+			high = flippedHigh;
+		}
+
+		if( i == 0 )
+		{
+			spriteZeroOnLine = true;
+		}
+		spriteX[spriteCount] = oam[i * 4 + 3];
+		spriteAttributes[spriteCount] = attributes;
+		spritePatternLow[spriteCount] = low;
+		spritePatternHigh[spriteCount] = high;
+		spriteCount++;
+	}
+}
+
+void PPU::incrementScrollX()
+{
+	// Coarse X, switching horizontal nametables at the edge
+	if( (currentAddress.w & 0x001f) == 31 )
+	{
+		currentAddress.w &= ~0x001f;
+		currentAddress.w ^= 0x0400;
+	}
+	else
+	{
+		currentAddress.w++;
+	}
+}
+
+void PPU::incrementScrollY()
+{
+	if( (currentAddress.w & 0x7000) != 0x7000 )
+	{
+		// Fine Y
+		currentAddress.w += 0x1000;
+	}
+	else
+	{
+		// Coarse Y, switching vertical nametables after row 29
+		currentAddress.w &= ~0x7000;
+		int coarseY = (currentAddress.w & 0x03e0) >> 5;
+		if( coarseY == 29 )
+		{
+			coarseY = 0;
+			currentAddress.w ^= 0x0800;
+		}
+		else if( coarseY == 31 )
+		{
+			coarseY = 0;
+		}
+		else
+		{
+			coarseY++;
+		}
+		currentAddress.w = (currentAddress.w & ~0x03e0) | (coarseY << 5);
+	}
+}
+
+bool PPU::isRenderingEnabled() const
+{
+	return registers.PPUMASK.showBackground || registers.PPUMASK.showSprites;
 }
 
 int PPU::getFrame() const
@@ -107,42 +362,283 @@ int PPU::getFrame() const
 	return frame;
 }
 
-const uint32_t* PPU::getFrameBuffer() const
+const uint32_t* PPU::getFrameBuffer()
 {
-	return framebuffer[(frame + 1) % 2];
+	// Frames that are the same as the last one converted are not converted again
+	if( argbFrame <= changedFrame )
+	{
+		// Convert each scanline with the color emphasis that it was drawn with
+		const uint8_t* pixels = getIndexedFrameBuffer();
+		const uint8_t* emphasis = lineEmphasis[drawBuffer ^ 1];
+		for( int line = 0; line < 240; line++ )
+		{
+			convertPixels(pixels + line * 256, argbColors[emphasis[line]], argbFramebuffer + line * 256, 256);
+		}
+		argbFrame = frame;
+	}
+
+	return argbFramebuffer;
+}
+
+uint8_t PPU::getBackgroundPixel( int x )
+{
+	Word address = currentAddress;
+
+	// Find the tile that the pixel is in, switching horizontal nametables
+	// at the edge
+	int offset = fineX + x;
+	int coarseX = (address.w & 0x001f) + offset / 8;
+	if( coarseX >= 32 )
+	{
+		coarseX -= 32;
+		address.w ^= 0x0400;
+	}
+	address.w = (address.w & ~0x001f) | coarseX;
+
+	uint16_t index = 0x2000 | (address.w & 0x0fff);
+	uint16_t tile = readByte(index) + (registers.PPUCTRL.backgroundTable ? 256 : 0);
+	return (getTileRow(tile, (address.w >> 12) & 0x7) >> ((offset % 8) * 8)) & 0x3;
+}
+
+const uint8_t* PPU::getIndexedFrameBuffer() const
+{
+	return framebuffer[drawBuffer ^ 1];
+}
+
+void PPU::expandAttributes( uint16_t address, uint8_t value )
+{
+	uint8_t* page = attributePages[(address >> 10) & 0x3];
+
+	// Each attribute byte covers a 4x4 tile block, with 2 bits for each
+	// 2x2 tile quadrant. The last row of blocks is only half used.
+	int block = (address & 0x3ff) - 0x3c0;
+	for( int row = 0; row < 4; row++ )
+	{
+		int tileRow = (block / 8) * 4 + row;
+		if( tileRow >= 30 )
+		{
+			break;
+		}
+		for( int col = 0; col < 4; col++ )
+		{
+			int tileCol = (block % 8) * 4 + col;
+			int shift = ((row & 2) ? 4 : 0) + ((col & 2) ? 2 : 0);
+			page[tileRow * 32 + tileCol] = (value >> shift) & 0x3;
+			backgroundCacheStamps[getNametablePage(address)][tileRow * 32 + tileCol] = 0;
+		}
+	}
+}
+
+int64_t PPU::getNextA12Rise( int64_t time ) const
+{
+	if( !registers.PPUMASK.showBackground && !registers.PPUMASK.showSprites )
+	{
+		return INT64_MAX;
+	}
+
+	// A12 rises when the sprite fetches at dot 257 move to the $1000 table,
+	// or when the background prefetch at dot 321 does. 8x16 sprites fetch
+	// from $1000 for the unused sprite slots, which is the common setup.
+	int dot;
+	if( registers.PPUCTRL.spriteHeight || (!registers.PPUCTRL.backgroundTable && registers.PPUCTRL.spriteTile) )
+	{
+		dot = 260;
+	}
+	else if( registers.PPUCTRL.backgroundTable && !registers.PPUCTRL.spriteTile )
+	{
+		dot = 324;
+	}
+	else
+	{
+		return INT64_MAX;
+	}
+
+	// Find the next rendered scanline (0-239, or the pre-render line) that
+	// hasn't passed the rise yet
+	int64_t offset = (time - frameStart) % (262 * 341);
+	if( offset < 0 )
+	{
+		offset += 262 * 341;
+	}
+	int64_t start = time - offset;
+	int line = offset / 341;
+	if( offset % 341 > dot )
+	{
+		line++;
+	}
+	if( line >= 240 && line < 261 )
+	{
+		line = 261;
+	}
+
+	// Line 262 is the first line of the next frame
+	return start + line * 341 + dot;
 }
 
 uint8_t PPU::getAttributeTableValue( uint16_t nametableAddress )
 {
-	nametableAddress = getNametableIndex(nametableAddress);
+	return attributePages[(nametableAddress >> 10) & 0x3][nametableAddress & 0x3ff];
+}
+
+int PPU::getSpriteHeight() const
+{
+	return registers.PPUCTRL.spriteHeight ? 16 : 8;
+}
+
+uint64_t PPU::getSpriteRow( int sprite, int row )
+{
+	uint16_t tile = getSpriteTile(sprite, row);
+	uint64_t tileRow = getTileRow(tile, row);
+	if( oam[sprite * 4 + 2] & BIT_6 )
+	{
+		tileRow = flipTileRow(tileRow);
+	}
+	return tileRow;
+}
+
+uint16_t PPU::getSpriteTile( int sprite, int& row )
+{
+	uint8_t index = oam[sprite * 4 + 1];
+
+	if( oam[sprite * 4 + 2] & BIT_7 )
+	{
+		row = getSpriteHeight() - 1 - row;
+	}
+
+	// 8x16 sprites select their pattern table with bit 0 of the index,
+	// and use two tiles
+	uint16_t tile;
+	if( registers.PPUCTRL.spriteHeight )
+	{
+		tile = ((index & 0x01) ? 256 : 0) + (index & 0xfe);
+		if( row >= 8 )
+		{
+			tile++;
+			row -= 8;
+		}
+	}
+	else
+	{
+		tile = index + (registers.PPUCTRL.spriteTile ? 256 : 0);
+	}
+	return tile;
+}
+
+int64_t PPU::getStatusChangeTime()
+{
+	catchUp();
+
+	// Reading clears the vblank flag, so the next read is already different
+	if( registers.PPUSTATUS.vblank )
+	{
+		return time;
+	}
+
+	int64_t lineStart = time - cycle;
+	int64_t changeTime = INT64_MAX;
+
+	// Sprite 0 hit and sprite overflow are cleared at the start of the
+	// pre-render scanline
+	if( registers.PPUSTATUS.spriteZeroHit || registers.PPUSTATUS.spriteOverflow )
+	{
+		int line = (scanline == 261 && cycle >= 1) ? 261 + 262 : 261;
+		changeTime = lineStart + (line - scanline) * 341 + 1;
+	}
+
+	// They are only set on visible scanlines while rendering. The dot
+	// renderer sets them at any dot. The scanline renderer sets them when
+	// it draws a line at cycle 256, apart from sprite 0 hits that it
+	// predicts then and schedules as events.
+	if( isRenderingEnabled() && !(registers.PPUSTATUS.spriteZeroHit && registers.PPUSTATUS.spriteOverflow) )
+	{
+		int64_t setTime;
+		if( renderMode == RENDER_DOT )
+		{
+			setTime = (scanline < 240) ? time : lineStart + (262 - scanline) * 341;
+		}
+		else
+		{
+			int line = scanline;
+			if( scanline >= 240 || cycle >= 256 )
+			{
+				line = (scanline < 239) ? scanline + 1 : 262;
+			}
+			setTime = lineStart + (line - scanline) * 341 + 256;
+		}
+		if( setTime < changeTime )
+		{
+			changeTime = setTime;
+		}
+	}
+
+	return changeTime;
+}
+
+uint32_t PPU::getTileStamp( uint16_t tile )
+{
+	// Tiles read through the mapper get a new stamp every time, so that
+	// nothing drawn from them is reused
+	int offset = nes.getMemory().getChrOffset(tile * 16);
+	if( offset < 0 )
+	{
+		return nextTileStamp++;
+	}
+
+	return tileStamps[offset / 16];
+}
+
+uint64_t PPU::getTileRow( uint16_t tile, int row )
+{
+	// Tiles are cached by where they are in CHR memory, so they stay
+	// decoded while their bank is switched out
+	int offset = nes.getMemory().getChrOffset(tile * 16);
+	if( offset < 0 )
+	{
+		return decodeTileRow(tile * 16 + row);
+	}
 
-	// Determine the 32x32 attribute table address
-	int row = ((nametableAddress & 0x3e0) >> 5) / 4;
-	int col = (nametableAddress & 0x1f) / 4;
+	int index = offset / 16;
+	if( !tileCacheValid[index] )
+	{
+		for( int i = 0; i < 8; i++ )
+		{
+			tileCache[index * 8 + i] = decodeTileRow(tile * 16 + i);
+		}
+		tileCacheValid[index] = true;
+	}
 
-	// Determine the 16x16 metatile for the 8x8 tile addressed
-	int shift = ((nametableAddress & BIT_6) ? 4 : 0) + ((nametableAddress & BIT_1) ? 2 : 0);
+	return tileCache[index * 8 + row];
+}
 
-	// Determine the offset into the attribute table
-	int offset = (nametableAddress & 0xc00) + 0x400 - 64 + (row * 8 + col);
+void PPU::getPaletteColors( uint8_t base, uint8_t colors[4][4] )
+{
+	for( int number = 0; number < 4; number++ )
+	{
+		colors[number][0] = palette[0] & 0x3f;
+		for( int index = 1; index < 4; index++ )
+		{
+			colors[number][index] = palette[base + number * 4 + index] & 0x3f;
+		}
+	}
+}
 
-	// Determine the attribute table value
-	return (nametable[offset] & (0x3 << shift)) >> shift;
+int PPU::getNametablePage( uint16_t address ) const
+{
+	return (nametablePages[(address >> 10) & 0x3] - nametable) / 0x400;
 }
 
-uint16_t PPU::getNametableIndex( uint16_t address )
+uint8_t& PPU::getNametableByte( uint16_t address )
 {
-	address = (address - 0x2000) % 0x1000;
-	int table = address / 0x400;
-	int offset = address % 0x400;
-	int mode = nes.getROMImage().getHeader()->getMirroring();
-	return (nametableMirrorLookup[mode][table] * 0x400 + offset) % 2048;
+	return nametablePages[(address >> 10) & 0x3][address & 0x3ff];
 }
 
 uint32_t* PPU::getVisualNametable()
 {
 	uint32_t* pixels = new uint32_t[256 * 2 * 240 * 2];
 
+	uint8_t colors[4][4];
+	getPaletteColors(0, colors);
+
 	int x = 0;
 	int y = 0;
 	for( int index = 0x2000; index < 0x3000; index++ )
@@ -154,21 +650,9 @@ uint32_t* PPU::getVisualNametable()
 		// Read the pixels of the tile
 		for( int row = 0; row < 8; row++ )
 		{
-			uint8_t plane1 = nes.getMemory().getMapper().readByte(tile * 16 + row);
-			uint8_t plane2 = nes.getMemory().getMapper().readByte(tile * 16 + row + 8);
-
-			for( int column = 0; column < 8; column++ )
-			{
-				uint8_t paletteIndex = (((plane1 & (1 << column)) ? 1 : 0) + ((plane2 & (1 << column)) ? 2 : 0));
-				uint8_t colorIndex = palette[attribute * 4 + paletteIndex];
-				if( paletteIndex == 0 )
-				{
-					colorIndex = palette[0];
-				}
-				uint32_t pixel = 0xff000000 | paletteRGB[colorIndex];
-
-				pixels[(y + row) * 512 + (x + (7 - column))] = pixel;
-			}
+			uint8_t tilePixels[8];
+			expandTileRow(getTileRow(tile, row), colors[attribute], tilePixels);
+			convertPixels(tilePixels, argbColors[0], pixels + (y + row) * 512 + x, 8);
 		}
 
 		x += 8;
@@ -250,21 +734,18 @@ uint32_t* PPU::getVisualPatternTable()
 {
 	uint32_t* pixels = new uint32_t[128 * 128 * 2];
 
+	static const uint8_t values[4] = { 0, 1, 2, 3 };
+	static const uint32_t colors[4] = { 0xff000000, 0xff555555, 0xffaaaaaa, 0xffffffff };
+
 	int x = 0;
 	int y = 0;
 	for( int index = 0; index < 0x2000; index += 16 )
 	{
 		for( int row = 0; row < 8; row++ )
 		{
-			uint8_t plane1 = nes.getMemory().getMapper().readByte(index + row);
-			uint8_t plane2 = nes.getMemory().getMapper().readByte(index + row + 8);
-
-			for( int column = 0; column < 8; column++ )
-			{
-				uint32_t pixel = 0xff000000 | ((((plane1 & (1 << column)) ? 1 : 0) + ((plane2 & (1 << column)) ? 2 : 0)) * 0x555555);
-
-				pixels[(y + row) * 256 + (x + (7 - column))] = pixel;
-			}
+			uint8_t tilePixels[8];
+			expandTileRow(getTileRow(index / 16, row), values, tilePixels);
+			convertPixels(tilePixels, colors, pixels + (y + row) * 256 + x, 8);
 		}
 
 		x += 8;
@@ -294,32 +775,176 @@ uint32_t* PPU::getVisualPatternTable()
 	return pixels;
 }
 
-uint8_t PPU::readByte( uint16_t address )
+void PPU::handleEvent( SchedulerEvent event, int64_t time )
 {
-	// Mirror all addresses above $3fff
-	address &= 0x3fff;
+	// Events are handled after they are due, so only run up to the time
+	// that the event happened
+	runUntil(time);
 
-	if( address < 0x2000 )
-	{
-		// CHR
-		return nes.getMemory().getMapper().readByte(address);
-	}
-	else if( address < 0x3f00 )
+	switch( event )
 	{
-		// Nametable
-		return nametable[getNametableIndex(address)];
+	case EVENT_VBLANK:
+		registers.PPUSTATUS.vblank = 1;
+		if( registers.PPUCTRL.nmiEnable )
+		{
+			nes.getCPU().requestNMI();
+		}
+		nes.getScheduler().schedule(EVENT_VBLANK, frameStart + 262 * 341 + 241 * 341 + 1);
+		break;
+	case EVENT_FRAME_END:
+		// Skipped frames leave the last rendered frame where it is
+		if( !skipRendering )
+		{
+			if( frameChanged || renderMode == RENDER_DOT )
+			{
+				changedFrame = frame;
+			}
+			drawBuffer ^= 1;
+		}
+		frameChanged = false;
+		frame++;
+		frameStart += 262 * 341;
+		nes.getScheduler().schedule(EVENT_FRAME_END, frameStart + 262 * 341);
+		break;
+	case EVENT_SPRITE_ZERO_HIT:
+		// The flag was set when the PPU ran up to the event
+		break;
+	default:
+		break;
 	}
+}
 
-	return 0;
+void PPU::loadBackgroundShifters()
+{
+	patternShiftLow    = (patternShiftLow & 0xff00) | nextPatternLow;
+	patternShiftHigh   = (patternShiftHigh & 0xff00) | nextPatternHigh;
+	attributeShiftLow  = (attributeShiftLow & 0xff00) | ((nextAttribute & 0x01) ? 0xff : 0x00);
+	attributeShiftHigh = (attributeShiftHigh & 0xff00) | ((nextAttribute & 0x02) ? 0xff : 0x00);
 }
 
-uint8_t PPU::readDataRegister()
+void PPU::prepareChrSwitch()
 {
-	uint8_t value = readByte(currentAddress.w);
+	// Draw everything up to now with the old tiles. Nothing else has to be
+	// done, since tiles are cached by where they are in CHR memory.
+	catchUp();
+	chrVersion++;
 
-	if( !registers.PPUCTRL.increment )
+	// Sprite 0 hit can only be predicted once the new tiles are in place
+	spriteZeroHitStale = true;
+}
+
+bool PPU::hasSpriteOverflow() const
+{
+	if( !registers.PPUMASK.showSprites )
 	{
-		currentAddress.w++;
+		return false;
+	}
+
+	// Sprites are drawn one line below their Y coordinate
+	int count = 0;
+	for( int i = 0; i < 64; i++ )
+	{
+		int row = scanline - 1 - oam[i * 4];
+		if( row >= 0 && row < getSpriteHeight() && ++count > 8 )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool PPU::isFrameChanged() const
+{
+	return changedFrame == frame - 1;
+}
+
+uint8_t PPU::readByte( uint16_t address )
+{
+	// Mirror all addresses above $3fff
+	address &= 0x3fff;
+
+	if( address < 0x2000 )
+	{
+		// CHR
+		return nes.getMemory().readChrByte(address);
+	}
+	else if( address < 0x3f00 )
+	{
+		// Nametable
+		return getNametableByte(address);
+	}
+
+	return 0;
+}
+
+void PPU::predictSpriteZeroHit()
+{
+	spriteZeroHitTime = INT64_MAX;
+	nes.getScheduler().cancel(EVENT_SPRITE_ZERO_HIT);
+
+	// The dot renderer finds sprite 0 hits as it draws
+	if( renderMode != RENDER_SCANLINE || registers.PPUSTATUS.spriteZeroHit ||
+		!registers.PPUMASK.showBackground || !registers.PPUMASK.showSprites )
+	{
+		return;
+	}
+
+	// Find the next scanline to be drawn. The current address already
+	// holds its scroll position.
+	int line;
+	int64_t lineStart = time - cycle;
+	if( scanline < 240 && cycle < 256 )
+	{
+		line = scanline;
+	}
+	else if( scanline < 239 )
+	{
+		line = scanline + 1;
+		lineStart += 341;
+	}
+	else
+	{
+		return;
+	}
+
+	int row = line - 1 - oam[0];
+	if( row < 0 || row >= getSpriteHeight() )
+	{
+		return;
+	}
+
+	// Find the first opaque sprite 0 pixel over an opaque background pixel
+	// that the PPU hasn't drawn yet. The flag is set on the dot after the pixel.
+	uint64_t spriteRow = getSpriteRow(0, row);
+	bool leftClipped = !registers.PPUMASK.showLeftBackground || !registers.PPUMASK.showLeftSprites;
+	for( int column = 0; column < 8; column++ )
+	{
+		int x = oam[3] + column;
+		if( x == 255 )
+		{
+			// Hits are never detected at the last pixel
+			break;
+		}
+
+		if( (x < 8 && leftClipped) || lineStart + x + 1 <= time ||
+			((spriteRow >> (column * 8)) & 0x3) == 0 || getBackgroundPixel(x) == 0 )
+		{
+			continue;
+		}
+
+		spriteZeroHitTime = lineStart + x + 1;
+		nes.getScheduler().schedule(EVENT_SPRITE_ZERO_HIT, spriteZeroHitTime);
+		break;
+	}
+}
+
+uint8_t PPU::readDataRegister()
+{
+	uint8_t value = readByte(currentAddress.w);
+
+	if( !registers.PPUCTRL.increment )
+	{
+		currentAddress.w++;
 	}
 	else
 	{
@@ -329,8 +954,33 @@ uint8_t PPU::readDataRegister()
 	return value;
 }
 
+void PPU::resolvePalette()
+{
+	// Grayscale mode only keeps the brightness of each color
+	uint8_t mask = registers.PPUMASK.grayscale ? 0x30 : 0x3f;
+
+	// Transparent pixels of every palette show the backdrop color
+	for( int address = 0; address < 32; address++ )
+	{
+		resolvedPalette[address] = palette[(address & 0x03) ? address : 0] & mask;
+	}
+}
+
+uint8_t PPU::readStatusRegister()
+{
+	uint8_t value = registers.PPUSTATUS.raw & 0xe0;
+
+	// Reading clears the vblank flag and the write toggle
+	registers.PPUSTATUS.vblank = 0;
+	writeToggle = false;
+
+	return value;
+}
+
 uint8_t PPU::readRegister( uint16_t address )
 {
+	catchUp();
+
 	switch( address )
 	{
 	// PPUCTRL
@@ -341,8 +991,7 @@ uint8_t PPU::readRegister( uint16_t address )
 		break;
 	// PPUSTATUS
 	case 0x2002:
-		writeToggle = false;
-		return (cycle % 2 == 0 ? 0xc0 : 0);
+		return readStatusRegister();
 	// OAMADDR
 	case 0x2003:
 		break;
@@ -365,143 +1014,610 @@ uint8_t PPU::readRegister( uint16_t address )
 	return 0;
 }
 
-void PPU::renderFrame()
+void PPU::renderPixel()
 {
-	// This is a quick way to render. It doesn't work with games that have scrolling.
-	uint32_t* buffer = framebuffer[frame % 2];
+	int x = cycle - 1;
 
-	// Draw the background (nametable)
-	int x = 0;
-	int y = 0;
-	for( int index = 0x2000; ; index++ )
+	// Background pixel, selected from the shift registers by fine X
+	uint8_t backgroundPixel = 0;
+	uint8_t backgroundPalette = 0;
+	if( registers.PPUMASK.showBackground && (registers.PPUMASK.showLeftBackground || x >= 8) )
 	{
-		// Lookup the pattern table entry
-		uint16_t tile = readByte(index) + (registers.PPUCTRL.backgroundTable ? 256 : 0);
-		uint8_t attribute = getAttributeTableValue(index);
+		uint16_t mask = 0x8000 >> fineX;
+		backgroundPixel = ((patternShiftLow & mask) ? 1 : 0) | ((patternShiftHigh & mask) ? 2 : 0);
+		backgroundPalette = ((attributeShiftLow & mask) ? 1 : 0) | ((attributeShiftHigh & mask) ? 2 : 0);
+	}
 
-		// Read the pixels of the tile
-		for( int row = 0; row < 8; row++ )
+	// Sprite pixel, from the first active sprite that isn't transparent
+	uint8_t spritePixel = 0;
+	uint8_t spritePalette = 0;
+	bool spriteBehind = false;
+	bool spriteZero = false;
+	if( registers.PPUMASK.showSprites && (registers.PPUMASK.showLeftSprites || x >= 8) )
+	{
+		for( int i = 0; i < spriteCount; i++ )
 		{
-			uint8_t plane1 = nes.getMemory().getMapper().readByte(tile * 16 + row);
-			uint8_t plane2 = nes.getMemory().getMapper().readByte(tile * 16 + row + 8);
-
-			for( int column = 0; column < 8; column++ )
+			if( spriteX[i] != 0 )
 			{
-				uint8_t paletteIndex = (((plane1 & (1 << column)) ? 1 : 0) + ((plane2 & (1 << column)) ? 2 : 0));
-				uint8_t colorIndex = palette[attribute * 4 + paletteIndex];
-				if( paletteIndex == 0 )
-				{
-					colorIndex = palette[0];
-				}
-				uint32_t pixel = 0xff000000 | paletteRGB[colorIndex];
+				continue;
+			}
 
-				buffer[(y + row) * 256 + (x + (7 - column))] = pixel;
+			spritePixel = ((spritePatternLow[i] & 0x80) ? 1 : 0) | ((spritePatternHigh[i] & 0x80) ? 2 : 0);
+			if( spritePixel != 0 )
+			{
+				spritePalette = 4 + (spriteAttributes[i] & 0x03);
+				spriteBehind = spriteAttributes[i] & BIT_5;
+				spriteZero = (i == 0 && spriteZeroOnLine);
+				break;
 			}
 		}
+	}
 
-		x += 8;
-		if( x >= 256 )
+	// Combine the two by priority
+	uint8_t address = 0;
+	if( backgroundPixel != 0 && spritePixel != 0 )
+	{
+		if( spriteZero && x != 255 )
+		{
+			registers.PPUSTATUS.spriteZeroHit = 1;
+		}
+		if( spriteBehind )
+		{
+			address = backgroundPalette * 4 + backgroundPixel;
+		}
+		else
+		{
+			address = spritePalette * 4 + spritePixel;
+		}
+	}
+	else if( backgroundPixel != 0 )
+	{
+		address = backgroundPalette * 4 + backgroundPixel;
+	}
+	else if( spritePixel != 0 )
+	{
+		address = spritePalette * 4 + spritePixel;
+	}
+
+	framebuffer[drawBuffer][scanline * 256 + x] = resolvedPalette[address];
+}
+
+void PPU::renderBackground( uint8_t* background )
+{
+	Word address = currentAddress;
+	int fineY = (address.w >> 12) & 0x7;
+
+	// Look up the row and palette of each tile, then draw them all at once
+	uint64_t tileRows[33];
+	uint8_t palettes[33];
+	for( int i = 0; i < 33; i++ )
+	{
+		uint16_t index = 0x2000 | (address.w & 0x0fff);
+		uint16_t tile = readByte(index) + (registers.PPUCTRL.backgroundTable ? 256 : 0);
+		tileRows[i] = getTileRow(tile, fineY);
+		palettes[i] = getAttributeTableValue(index);
+
+		// Move to the next tile, switching horizontal nametables at the edge
+		if( (address.w & 0x001f) == 31 )
 		{
-			x = 0;
-			y += 8;
-			if( y >= 240 )
+			address.w &= ~0x001f;
+			address.w ^= 0x0400;
+		}
+		else
+		{
+			address.w++;
+		}
+	}
+	expandBackground(tileRows, palettes, background, 33);
+}
+
+void PPU::renderCachedBackground( uint8_t* background )
+{
+	int coarseX = currentAddress.w & 0x001f;
+	int coarseY = (currentAddress.w >> 5) & 0x001f;
+	int fineY = (currentAddress.w >> 12) & 0x7;
+
+	// The line starts in one nametable and wraps into the one beside it
+	uint16_t table = currentAddress.w & 0x0c00;
+	int pages[2] = { getNametablePage(table), getNametablePage(table ^ 0x0400) };
+	int x = 0;
+	for( int i = 0; i < 2; i++ )
+	{
+		int firstColumn = (i == 0) ? coarseX : 0;
+		int lastColumn = (i == 0) ? 31 : coarseX;
+		uint8_t* row = backgroundCache + pages[i] * 256 * 240 + (coarseY * 8 + fineY) * 256;
+
+		// Redraw tiles that have changed since they were cached, including
+		// ones whose pattern has been switched or written
+		for( int column = firstColumn; column <= lastColumn; column++ )
+		{
+			int tile = coarseY * 32 + column;
+			uint16_t index = nametable[pages[i] * 0x400 + tile] + (registers.PPUCTRL.backgroundTable ? 256 : 0);
+			uint32_t stamp = getTileStamp(index);
+			if( backgroundCacheStamps[pages[i]][tile] != stamp )
 			{
-				break;
+				renderCachedTile(pages[i], tile, stamp);
 			}
 		}
+
+		int length = (lastColumn - firstColumn + 1) * 8;
+		memcpy(background + x, row + firstColumn * 8, length);
+		x += length;
 	}
+}
 
-	// Draw sprites (OAM)
-	for( int i = 0; i < 64; i++ )
+void PPU::renderCachedTile( int page, int tile, uint32_t stamp )
+{
+	uint16_t index = nametable[page * 0x400 + tile] + (registers.PPUCTRL.backgroundTable ? 256 : 0);
+	const uint8_t* colors = backgroundPaletteAddresses[attributes[page * 0x400 + tile]];
+
+	uint8_t* pixels = backgroundCache + page * 256 * 240 + (tile / 32) * 8 * 256 + (tile % 32) * 8;
+	for( int row = 0; row < 8; row++ )
 	{
-		// Read OAM for the sprite
-		uint8_t y          = oam[i * 4];
-		uint8_t index      = oam[i * 4 + 1];
-		uint8_t attributes = oam[i * 4 + 2];
-		uint8_t x          = oam[i * 4 + 3];
+		expandTileRow(getTileRow(index, row), colors, pixels + row * 256);
+	}
+
+	backgroundCacheStamps[page][tile] = stamp;
+}
 
-		// Check if the sprite is visible
-		if( y >= 0xef || x >= 0xf9 )
+bool PPU::drawScanline( uint8_t* buffer )
+{
+	bool spriteOverflow = false;
+
+	// Palette address of each background pixel, 0 where it's transparent.
+	// One more tile than fits on the line is drawn to allow for fine scrolling.
+	uint8_t background[33 * 8];
+	if( registers.PPUMASK.showBackground )
+	{
+		// The cache only holds the 30 rows of tiles in each nametable
+		if( backgroundCacheEnabled && ((currentAddress.w >> 5) & 0x1f) < 30 )
 		{
-			continue;
+			renderCachedBackground(background);
 		}
+		else
+		{
+			renderBackground(background);
+		}
+		if( !registers.PPUMASK.showLeftBackground )
+		{
+			memset(background + fineX, 0, 8);
+		}
+	}
+	else
+	{
+		memset(background, 0, sizeof(background));
+	}
 
-		// Determine the tile to use
-		uint16_t tile = index + (registers.PPUCTRL.spriteTile ? 256 : 0);
-		bool flipX = attributes & BIT_6;
-		bool flipY = attributes & BIT_7;
-
-		// Copy pixels to the framebuffer
-		for( int row = 0; row < 8; row++ )
+	// Palette address of each sprite pixel, with BIT_7 set for sprites that
+	// are behind the background, 0 where there is no sprite
+	uint8_t sprites[256 + 8];
+	memset(sprites, 0, sizeof(sprites));
+	if( registers.PPUMASK.showSprites )
+	{
+		// Only the first 8 sprites on the scanline in OAM order are drawn,
+		// and lower numbered sprites have priority
+		int count = 0;
+		for( int i = 0; i < 64; i++ )
 		{
-			uint8_t plane1 = nes.getMemory().getMapper().readByte(tile * 16 + row);
-			uint8_t plane2 = nes.getMemory().getMapper().readByte(tile * 16 + row + 8);
+			// Sprites are drawn one line below their Y coordinate
+			int row = scanline - 1 - oam[i * 4];
+			if( row < 0 || row >= getSpriteHeight() )
+			{
+				continue;
+			}
+
+			if( count == 8 )
+			{
+				spriteOverflow = true;
+				break;
+			}
+			count++;
+
+			uint8_t attributes = oam[i * 4 + 2];
+			uint8_t x          = oam[i * 4 + 3];
 
+			uint8_t colors[4];
+			for( int value = 0; value < 4; value++ )
+			{
+				colors[value] = (0x10 + (attributes & 0x03) * 4 + value) | ((attributes & BIT_5) ? BIT_7 : 0);
+			}
+
+			// Draw under the higher priority sprites, skipping transparent pixels
+			uint8_t pixels[8] = { 0 };
+			expandTileRowTransparent(getSpriteRow(i, row), colors, pixels);
 			for( int column = 0; column < 8; column++ )
 			{
-				uint8_t paletteIndex = (((plane1 & (1 << column)) ? 1 : 0) + ((plane2 & (1 << column)) ? 2 : 0));
-				uint8_t colorIndex = palette[0x10 + (attributes & 0x03) * 4 + paletteIndex];
-				if( paletteIndex == 0 )
+				if( sprites[x + column] == 0 )
 				{
-					// Skip transparent pixels
-					continue;
+					sprites[x + column] = pixels[column];
 				}
-				uint32_t pixel = 0xff000000 | paletteRGB[colorIndex];
+			}
+		}
+		if( !registers.PPUMASK.showLeftSprites )
+		{
+			memset(sprites, 0, 8);
+		}
+	}
 
-				int xOffset = 7 - column;
-				if( flipX )
-				{
-					xOffset = column;
-				}
-				int yOffset = row;
-				if( flipY )
-				{
-					yOffset = 7 - row;
-				}
+	combinePixels(background + fineX, sprites, resolvedPalette, buffer, 256);
+
+	return spriteOverflow;
+}
+
+void PPU::renderScanline()
+{
+	if( skipRendering )
+	{
+		// Nothing is drawn, but the sprite overflow flag is still set
+		if( hasSpriteOverflow() )
+		{
+			registers.PPUSTATUS.spriteOverflow = 1;
+		}
+	}
+	else
+	{
+		updateScanline();
+	}
 
-				buffer[(y + yOffset) * 256 + (x + xOffset)] = pixel;
+	// Increment the vertical scroll position and reload the horizontal one
+	if( isRenderingEnabled() )
+	{
+		incrementScrollY();
+		currentAddress.w = (currentAddress.w & ~0x041f) | (tempAddress.w & 0x041f);
+	}
+}
+
+void PPU::updateScanline()
+{
+	uint8_t* buffer = framebuffer[drawBuffer] + scanline * 256;
+
+	// Everything that the scanline is drawn from, apart from memory
+	// contents which are covered by the version number
+	ScanlineState state;
+	state.address = currentAddress.w;
+	state.fineX = fineX;
+	state.control = registers.PPUCTRL.raw & (BIT_3 | BIT_4 | BIT_5);
+	state.mask = registers.PPUMASK.raw;
+	state.version = contentVersion;
+	state.chrVersion = chrVersion;
+
+	// If the scanline was drawn the same way in the last frame, copy it
+	// from the other framebuffer instead of drawing it again. The pattern
+	// tiles it uses are only recorded and compared when everything else is
+	// the same but CHR data has changed since, which is when they matter.
+	ScanlineState& last = lineState[scanline];
+	bool unchanged = last.address == state.address && last.fineX == state.fineX && last.control == state.control &&
+		last.mask == state.mask && last.version == state.version;
+	state.tileCount = -1;
+	if( unchanged && last.chrVersion != state.chrVersion )
+	{
+		stampScanlineTiles(state);
+		unchanged = last.tileCount == state.tileCount &&
+			memcmp(last.tiles, state.tiles, state.tileCount * sizeof(uint32_t)) == 0;
+	}
+	else if( unchanged && last.tileCount >= 0 )
+	{
+		memcpy(state.tiles, last.tiles, last.tileCount * sizeof(uint32_t));
+		state.tileCount = last.tileCount;
+	}
+
+	if( unchanged )
+	{
+		memcpy(buffer, framebuffer[drawBuffer ^ 1] + scanline * 256, 256);
+		state.spriteOverflow = last.spriteOverflow;
+	}
+	else
+	{
+		state.spriteOverflow = drawScanline(buffer);
+		frameChanged = true;
+	}
+	if( state.spriteOverflow )
+	{
+		registers.PPUSTATUS.spriteOverflow = 1;
+	}
+	last = state;
+}
+
+template <PPURenderMode M>
+void PPU::run( int64_t time )
+{
+	// Advance to each cycle where something happens, rather than one
+	// cycle at a time
+	while( this->time < time )
+	{
+		int next = 341;
+		if( M == RENDER_DOT )
+		{
+			// Every cycle does something
+			next = cycle + 1;
+		}
+		else if( scanline < 240 && cycle < 256 )
+		{
+			// Visible scanlines are rendered all at once at cycle 256
+			next = 256;
+		}
+		else if( scanline == 261 && cycle < 1 )
+		{
+			// The status flags are cleared at the start of the pre-render scanline
+			next = 1;
+		}
+		else if( scanline == 261 && cycle < 280 )
+		{
+			// The scroll position is reloaded at the start of the pre-render scanline
+			next = 280;
+		}
+		if( M == RENDER_SCANLINE && spriteZeroHitTime - this->time < next - cycle )
+		{
+			// Stop at a predicted sprite 0 hit
+			next = cycle + (int)(spriteZeroHitTime - this->time);
+		}
+
+		int64_t remaining = next - cycle;
+		if( time - this->time < remaining )
+		{
+			cycle += time - this->time;
+			this->time = time;
+			break;
+		}
+
+		this->time += remaining;
+		cycle = next;
+		if( cycle == 341 )
+		{
+			cycle = 0;
+			scanline++;
+			if( scanline > 261 )
+			{
+				scanline = 0;
+			}
+		}
+
+		if( scanline == 261 && cycle == 1 )
+		{
+			registers.PPUSTATUS.vblank = 0;
+			registers.PPUSTATUS.spriteZeroHit = 0;
+			registers.PPUSTATUS.spriteOverflow = 0;
+		}
+
+		if( scanline < 240 && cycle == 256 )
+		{
+			lineEmphasis[drawBuffer][scanline] = registers.PPUMASK.raw >> 5;
+		}
+
+		if( M == RENDER_DOT )
+		{
+			stepDot();
+			continue;
+		}
+
+		if( this->time == spriteZeroHitTime )
+		{
+			registers.PPUSTATUS.spriteZeroHit = 1;
+			spriteZeroHitTime = INT64_MAX;
+		}
+
+		if( scanline < 240 && cycle == 256 )
+		{
+			renderScanline();
+			predictSpriteZeroHit();
+		}
+		else if( scanline == 261 && cycle == 280 )
+		{
+			if( isRenderingEnabled() )
+			{
+				currentAddress = tempAddress;
 			}
 		}
 	}
 }
 
-void PPU::step()
+void PPU::runUntil( int64_t time )
 {
-	// Increment the timing counters
-	cycle++;
-	if( cycle > 340 )
+	if( spriteZeroHitStale )
 	{
-		cycle = 0;
-		scanline++;
-		if( scanline > 261 )
+		spriteZeroHitStale = false;
+		predictSpriteZeroHit();
+	}
+
+	switch( renderMode )
+	{
+	case RENDER_SCANLINE:
+		run<RENDER_SCANLINE>(time);
+		break;
+	case RENDER_DOT:
+		run<RENDER_DOT>(time);
+		break;
+	}
+}
+
+void PPU::setBackgroundCacheEnabled( bool enabled )
+{
+	catchUp();
+	backgroundCacheEnabled = enabled;
+	memset(backgroundCacheStamps, 0, sizeof(backgroundCacheStamps));
+}
+
+void PPU::setFrameSkipped( bool skipped )
+{
+	catchUp();
+	skipRendering = skipped;
+}
+
+void PPU::setMirroring( NametableMirrorMode mode )
+{
+	catchUp();
+	for( int table = 0; table < 4; table++ )
+	{
+		nametablePages[table] = nametable + nametableMirrorLookup[mode][table] * 0x400;
+		attributePages[table] = attributes + nametableMirrorLookup[mode][table] * 0x400;
+	}
+	contentVersion++;
+}
+
+void PPU::setRenderMode( PPURenderMode mode )
+{
+	catchUp();
+	renderMode = mode;
+	predictSpriteZeroHit();
+
+	// The dot renderer doesn't keep track of what it drew
+	contentVersion++;
+}
+
+void PPU::stampScanlineTiles( ScanlineState& state )
+{
+	state.tileCount = 0;
+
+	// The background tiles, walked the same way as renderBackground()
+	if( registers.PPUMASK.showBackground )
+	{
+		Word address = currentAddress;
+		for( int i = 0; i < 33; i++ )
 		{
-			scanline = 0;
-			frame++;
-			renderFrame();
+			uint16_t tile = getNametableByte(address.w) + (registers.PPUCTRL.backgroundTable ? 256 : 0);
+			state.tiles[state.tileCount++] = getTileStamp(tile);
+
+			if( (address.w & 0x001f) == 31 )
+			{
+				address.w &= ~0x001f;
+				address.w ^= 0x0400;
+			}
+			else
+			{
+				address.w++;
+			}
 		}
 	}
 
-	// Check for vblank
-	if( scanline == 241 && cycle == 1 )
+	// The tiles of the sprites that are drawn, the first 8 on the scanline
+	if( registers.PPUMASK.showSprites )
 	{
-		if( registers.PPUCTRL.nmiEnable )
+		int count = 0;
+		for( int i = 0; i < 64 && count < 8; i++ )
 		{
-			nes.getCPU().requestNMI();
+			int row = scanline - 1 - oam[i * 4];
+			if( row < 0 || row >= getSpriteHeight() )
+			{
+				continue;
+			}
+
+			state.tiles[state.tileCount++] = getTileStamp(getSpriteTile(i, row));
+			count++;
 		}
 	}
 }
 
+void PPU::stepDot()
+{
+	bool visible = scanline < 240;
+	bool preRender = scanline == 261;
+
+	if( !visible && !preRender )
+	{
+		return;
+	}
+
+	if( !isRenderingEnabled() )
+	{
+		// Only the backdrop color is drawn
+		if( visible && cycle >= 1 && cycle <= 256 )
+		{
+			framebuffer[drawBuffer][scanline * 256 + cycle - 1] = resolvedPalette[0];
+		}
+		return;
+	}
+
+	// Background fetches, in the order the hardware makes them over each
+	// 8 cycle tile. The next scanline's first two tiles are fetched at the
+	// end of the current one.
+	if( (cycle >= 2 && cycle <= 257) || (cycle >= 321 && cycle <= 337) )
+	{
+		patternShiftLow <<= 1;
+		patternShiftHigh <<= 1;
+		attributeShiftLow <<= 1;
+		attributeShiftHigh <<= 1;
+
+		uint16_t tileAddress = (registers.PPUCTRL.backgroundTable ? 0x1000 : 0) | (nextTile << 4) | ((currentAddress.w >> 12) & 0x7);
+		switch( (cycle - 1) % 8 )
+		{
+		case 0:
+			loadBackgroundShifters();
+			nextTile = readByte(0x2000 | (currentAddress.w & 0x0fff));
+			break;
+		case 2:
+			nextAttribute = getAttributeTableValue(0x2000 | (currentAddress.w & 0x0fff));
+			break;
+		case 4:
+			nextPatternLow = readByte(tileAddress);
+			break;
+		case 6:
+			nextPatternHigh = readByte(tileAddress + 8);
+			break;
+		case 7:
+			incrementScrollX();
+			break;
+		}
+	}
+
+	// Sprites wait until their X coordinate, then shift out their pixels
+	if( visible && cycle >= 2 && cycle <= 257 )
+	{
+		for( int i = 0; i < spriteCount; i++ )
+		{
+			if( spriteX[i] > 0 )
+			{
+				spriteX[i]--;
+			}
+			else
+			{
+				spritePatternLow[i] <<= 1;
+				spritePatternHigh[i] <<= 1;
+			}
+		}
+	}
+
+	if( cycle == 256 )
+	{
+		incrementScrollY();
+	}
+	else if( cycle == 257 )
+	{
+		loadBackgroundShifters();
+		currentAddress.w = (currentAddress.w & ~0x041f) | (tempAddress.w & 0x041f);
+
+		// The pre-render scanline has no sprites for the next line
+		if( visible )
+		{
+			evaluateSprites();
+		}
+		else
+		{
+			spriteCount = 0;
+		}
+	}
+	else if( preRender && cycle >= 280 && cycle <= 304 )
+	{
+		currentAddress.w = (currentAddress.w & ~0x7be0) | (tempAddress.w & 0x7be0);
+	}
+
+	if( visible && cycle >= 1 && cycle <= 256 )
+	{
+		renderPixel();
+	}
+}
+
 void PPU::writeAddressRegister( uint8_t value )
 {
 	if( !writeToggle )
 	{
 		// Upper byte
-		currentAddress.h = value;
+		tempAddress.h = value & 0x3f;
 	}
 	else
 	{
 		// Lower byte
-		currentAddress.l = value;
+		tempAddress.l = value;
+		currentAddress = tempAddress;
 	}
 	writeToggle = !writeToggle;
 }
@@ -513,27 +1629,79 @@ void PPU::writeByte( uint16_t address, uint8_t value )
 
 	if( address < 0x2000 )
 	{
-		// CHR
-		nes.getMemory().getMapper().writeByte(address, value);
+		// CHR. Nothing has to be redrawn unless the write changed it, as it
+		// doesn't when the byte is already set or is in CHR ROM. When it
+		// does, only the tile it is in has changed.
+		Memory& memory = nes.getMemory();
+		uint8_t old = memory.readChrByte(address);
+		memory.writeChrByte(address, value);
+		if( memory.readChrByte(address) == old )
+		{
+			return;
+		}
+
+		int offset = memory.getChrOffset(address);
+		if( offset >= 0 )
+		{
+			tileCacheValid[offset / 16] = false;
+			tileStamps[offset / 16] = nextTileStamp++;
+		}
+		chrVersion++;
 	}
 	else if( address < 0x3f00 )
 	{
 		// Nametable
-		nametable[getNametableIndex(address)] = value;
+		if( getNametableByte(address) == value )
+		{
+			return;
+		}
+		getNametableByte(address) = value;
+		contentVersion++;
+		if( (address & 0x3ff) >= 0x3c0 )
+		{
+			expandAttributes(address, value);
+		}
+		else
+		{
+			backgroundCacheStamps[getNametablePage(address)][address & 0x3ff] = 0;
+		}
 	}
 	else if( address < 0x3f20 )
 	{
 		// Palette data
+		bool changed = palette[address - 0x3f00] != value;
 		palette[address - 0x3f00] = value;
 
 		// Mirroring
 		if( address == 0x3f10 || address == 0x3f14 || address == 0x3f18 || address == 0x3f1c )
 		{
+			changed |= palette[address - 0x3f10] != value;
 			palette[address - 0x3f10] = value;
 		}
+		if( changed )
+		{
+			resolvePalette();
+			contentVersion++;
+		}
 	}
 }
 
+void PPU::writeScrollRegister( uint8_t value )
+{
+	if( !writeToggle )
+	{
+		// Horizontal scroll
+		tempAddress.w = (tempAddress.w & ~0x001f) | (value >> 3);
+		fineX = value & 0x7;
+	}
+	else
+	{
+		// Vertical scroll
+		tempAddress.w = (tempAddress.w & ~0x73e0) | ((value & 0x07) << 12) | ((value & 0xf8) << 2);
+	}
+	writeToggle = !writeToggle;
+}
+
 void PPU::writeDataRegister( uint8_t value )
 {
 	writeByte( currentAddress.w, value );
@@ -549,25 +1717,71 @@ void PPU::writeDataRegister( uint8_t value )
 
 void PPU::writeDMA( uint8_t page )
 {
+	catchUp();
+
 	uint16_t address = (uint16_t)page << 8;
 	for( int i = 0; i < 256; i++ )
 	{
-		oam[oamAddress] = nes.getMemory().readByte(address);
+		uint8_t value = nes.getMemory().readByte(address);
+		if( oam[oamAddress] != value )
+		{
+			oam[oamAddress] = value;
+			contentVersion++;
+		}
 		address++;
 		oamAddress++;
 	}
+
+	predictSpriteZeroHit();
 }
 
 void PPU::writeRegister( uint16_t address, uint8_t value )
 {
+	catchUp();
+
 	switch( address )
 	{
 	// PPUCTRL
 	case 0x2000:
-		registers.PPUCTRL.raw = value;
+		{
+			// The mapper may be watching which pattern tables are fetched from
+			bool tablesChanged = (registers.PPUCTRL.raw ^ value) & (BIT_3 | BIT_4 | BIT_5);
+			if( tablesChanged )
+			{
+				nes.getMemory().getMapper().beginPPUChange();
+			}
+			registers.PPUCTRL.raw = value;
+			tempAddress.w = (tempAddress.w & ~0x0c00) | ((value & 0x03) << 10);
+			if( tablesChanged )
+			{
+				nes.getMemory().getMapper().endPPUChange();
+			}
+			predictSpriteZeroHit();
+		}
 		break;
 	// PPUMASK
 	case 0x2001:
+		{
+			// Only grayscale mode affects the resolved palette
+			bool grayscaleChanged = (registers.PPUMASK.raw ^ value) & BIT_0;
+
+			// The mapper may be watching whether rendering is enabled
+			bool renderingChanged = (registers.PPUMASK.raw ^ value) & (BIT_3 | BIT_4);
+			if( renderingChanged )
+			{
+				nes.getMemory().getMapper().beginPPUChange();
+			}
+			registers.PPUMASK.raw = value;
+			if( grayscaleChanged )
+			{
+				resolvePalette();
+			}
+			if( renderingChanged )
+			{
+				nes.getMemory().getMapper().endPPUChange();
+			}
+			predictSpriteZeroHit();
+		}
 		break;
 	// PPUSTATUS
 	case 0x2002:
@@ -578,15 +1792,28 @@ void PPU::writeRegister( uint16_t address, uint8_t value )
 		break;
 	// OAMDATA
 	case 0x2004:
-		oam[oamAddress] = value;
+		if( oam[oamAddress] != value )
+		{
+			oam[oamAddress] = value;
+			contentVersion++;
+
+			// Only sprite 0 itself can move its hit
+			if( oamAddress < 4 )
+			{
+				predictSpriteZeroHit();
+			}
+		}
 		oamAddress++;
 		break;
 	// PPUSCROLL
 	case 0x2005:
+		writeScrollRegister(value);
+		predictSpriteZeroHit();
 		break;
 	// PPUADDR
 	case 0x2006:
 		writeAddressRegister(value);
+		predictSpriteZeroHit();
 		break;
 	// PPUDATA
 	case 0x2007:
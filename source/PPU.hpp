@@ -1,10 +1,32 @@
 #ifndef PPU_HPP
 #define PPU_HPP
 
+#include "Scheduler.hpp"
 #include "Types.hpp"
 
 class NES;
 
+/**
+ * Rendering pipelines that the PPU can use.
+ */
+enum PPURenderMode
+{
+	RENDER_SCANLINE, /**< Draw each scanline at once. Fast, but mid-scanline changes are not seen. */
+	RENDER_DOT       /**< Run the rendering pipeline one dot at a time, like the hardware does. */
+};
+
+/**
+ * Ways that the four logical nametables can be mapped to nametable memory.
+ */
+enum NametableMirrorMode
+{
+	MIRROR_HORIZONTAL   = 0, /**< $2000 and $2400 share a page, as do $2800 and $2c00. */
+	MIRROR_VERTICAL     = 1, /**< $2000 and $2800 share a page, as do $2400 and $2c00. */
+	MIRROR_SINGLE_LOWER = 2, /**< All nametables use the first page. */
+	MIRROR_SINGLE_UPPER = 3, /**< All nametables use the second page. */
+	MIRROR_FOUR_SCREEN  = 4  /**< Each nametable has its own page, using extra memory on the cart. */
+};
+
 /**
  * Emulates the Picture Processing Unit.
  */
@@ -20,9 +42,39 @@ public:
 	int getFrame() const;
 
 	/**
-	 * Get the rendered frame buffer.
+	 * Get the last rendered frame, converted to ARGB.
+	 *
+	 * The frame is only converted when this is called, and only once per frame.
+	 */
+	const uint32_t* getFrameBuffer();
+
+	/**
+	 * Get the last rendered frame as NES color indices (0-63), one byte
+	 * per pixel. This is cheaper than getFrameBuffer() for consumers that
+	 * don't need ARGB pixels.
+	 */
+	const uint8_t* getIndexedFrameBuffer() const;
+
+	/**
+	 * Get the first time at or after a master clock time that PPU address
+	 * line A12 rises during rendering, assuming the current pattern table
+	 * selection and rendering state stay the same. Mappers with scanline
+	 * counters clock them from these rises, which happen at most once per
+	 * scanline when the background and sprites use different pattern tables.
+	 *
+	 * @return the time, or INT64_MAX if A12 doesn't rise while rendering.
+	 */
+	int64_t getNextA12Rise( int64_t time ) const;
+
+	/**
+	 * Get the earliest time that reading PPUSTATUS could return something
+	 * other than a read at the current time, apart from the changes made
+	 * by scheduled events. Loops that poll the register can be skipped up
+	 * to this time, since every read before it has the same result.
+	 *
+	 * @return the time, or INT64_MAX if nothing but events changes the flags.
 	 */
-	const uint32_t* getFrameBuffer() const;
+	int64_t getStatusChangeTime();
 
 	/**
 	 * Get an ARGB representation of the nametable.
@@ -39,15 +91,65 @@ public:
 	 */
 	uint32_t* getVisualPatternTable();
 
+	/**
+	 * Handle a timing event scheduled by the PPU.
+	 *
+	 * @param time the master clock time that the event was scheduled for.
+	 */
+	void handleEvent( SchedulerEvent event, int64_t time );
+
+	/**
+	 * Prepare for the CHR data visible to the PPU to change without going
+	 * through the PPU, such as when a mapper switches CHR banks. This must
+	 * be called just before the change, so that the PPU can catch up using
+	 * the old data first.
+	 */
+	void prepareChrSwitch();
+
+	/**
+	 * Check if the last frame was drawn and differs from the one before it.
+	 * When it doesn't, the frame buffers hold the same image as before and
+	 * there is no need to display it again.
+	 */
+	bool isFrameChanged() const;
+
 	/**
 	 * Read a PPU register value.
 	 */
 	uint8_t readRegister( uint16_t address );
 
 	/**
-	 * Step the PPU emulation by one cycle.
+	 * Run the PPU forward until it reaches a master clock time.
+	 *
+	 * The PPU is only run when its state can be observed: when the CPU
+	 * accesses one of its registers, and when one of its events is due.
+	 */
+	void runUntil( int64_t time );
+
+	/**
+	 * Enable or disable the background cache. While enabled, the scanline
+	 * renderer keeps a pre-rendered image of each nametable and copies
+	 * scanlines out of it, only redrawing tiles that have changed.
+	 */
+	void setBackgroundCacheEnabled( bool enabled );
+
+	/**
+	 * Skip drawing the frames that follow. Timing, interrupts and the
+	 * status flags are unaffected, but the frame buffers keep the last
+	 * frame that was drawn.
+	 */
+	void setFrameSkipped( bool skipped );
+
+	/**
+	 * Change how the nametables are mirrored. Mappers that control
+	 * mirroring call this when it changes.
 	 */
-	void step();
+	void setMirroring( NametableMirrorMode mode );
+
+	/**
+	 * Select the rendering pipeline to use.
+	 */
+	void setRenderMode( PPURenderMode mode );
 
 	/**
 	 * Have the PPU perform a DMA transfer.
@@ -60,15 +162,6 @@ public:
 	void writeRegister( uint16_t address, uint8_t value );
 
 private:
-	/**
-	 * Mirror mode for the NameTable.
-	 */
-	enum NametableMirrorMode
-	{
-		MIRROR_HORIZONTAL = 0,
-		MIRROR_VERTICAL   = 1,
-	};
-
 	/**
 	 * PPU Registers that can be directly read/written to.
 	 */
@@ -107,9 +200,26 @@ private:
 			uint8_t raw;
 			Bit<5> spriteOverflow;
 			Bit<6> spriteZeroHit;
+			Bit<7> vblank;
 		} PPUSTATUS;
 	};
 
+	/**
+	 * The state that a scanline was drawn with by the scanline renderer.
+	 */
+	struct ScanlineState
+	{
+		uint16_t address;    /**< The current address (v) at the start of the scanline. */
+		uint8_t fineX;       /**< The fine horizontal scroll. */
+		uint8_t control;     /**< The PPUCTRL bits that select pattern tables and sprite height. */
+		uint8_t mask;        /**< PPUMASK. */
+		uint32_t version;    /**< The content version when the scanline was drawn. */
+		uint32_t chrVersion; /**< The CHR version when the scanline was drawn. */
+		bool spriteOverflow; /**< True if there were more than 8 sprites on the scanline. */
+		int tileCount;       /**< Number of pattern table tiles that the scanline was drawn from, or -1 if they weren't recorded. */
+		uint32_t tiles[41];  /**< The stamp of each tile that the scanline was drawn from, 33 background tiles and 8 sprites at most. */
+	};
+
 	//*****************************************************************
 	// Member variables
 	//*****************************************************************
@@ -120,21 +230,76 @@ private:
 	uint8_t oamAddress; /**< $2003 (OAMADDR) */
 
 	// Memory
-	uint8_t palette[32];     /**< 32 bytes of palette data. */
-	uint8_t nametable[2048]; /**< 2kb nametable data. */
+	uint8_t palette[32];         /**< 32 bytes of palette data. */
+	uint8_t resolvedPalette[32]; /**< The NES color drawn for each palette address, after grayscale and backdrop mirroring. */
+	uint8_t nametable[4096];     /**< 2kb nametable data, plus 2kb more for four-screen mirroring. */
+	uint8_t* nametablePages[4];  /**< The memory used by each 1kb logical nametable at $2000, $2400, $2800 and $2c00. */
+	uint8_t attributes[4096];    /**< The palette number of each tile, expanded from the attribute table and laid out like nametable. */
+	uint8_t* attributePages[4];  /**< The expanded attributes of each logical nametable. */
 	uint8_t oam[256];
 
-	// PPU Address control
-	Word currentAddress; /**< The current address that will be accessed on the next PPU read/write. */
-	bool writeToggle;    /**< Toggles whether the low or high bit of the current address will be set on the next write to PPUADDR. */
+	// Decoded pattern table
+	uint64_t* tileCache;    /**< Each row of each tile in CHR memory, decoded into one pixel value (0-3) per byte, leftmost pixel in the low byte. */
+	bool* tileCacheValid;   /**< True for tiles in CHR memory that have been decoded since they last changed. */
+	uint32_t* tileStamps;   /**< A number unique to the contents of each tile in CHR memory, changed when the tile is written. */
+	uint32_t nextTileStamp; /**< The next unused tile stamp. */
+
+	// Background cache (scanline renderer only)
+	bool backgroundCacheEnabled;            /**< True if the scanline renderer draws the background from the cache. */
+	uint8_t* backgroundCache;               /**< Palette address of each background pixel of each 1kb nametable page, 256x240 pixels per page. */
+	uint32_t backgroundCacheStamps[4][960]; /**< The stamp of the pattern tile that each tile of each page was drawn with, or 0 if it must be redrawn. */
 
-	// Timing Counters
-	int frame;    /**< The current frame number. */
-	int scanline; /**< The scanline number of the current frame. */
-	int cycle;    /**< The cycle number of the current scanline. */
+	// PPU Address control
+	Word currentAddress; /**< The current address that will be accessed on the next PPU read/write (v). */
+	Word tempAddress;    /**< The address that the current address is reloaded from while rendering (t). */
+	uint8_t fineX;       /**< The fine horizontal scroll (x). */
+	bool writeToggle;    /**< Toggles between the first and second write to PPUSCROLL and PPUADDR (w). */
+
+	// Timing
+	int frame;          /**< The current frame number. */
+	int scanline;       /**< The scanline number of the current frame. */
+	int cycle;          /**< The cycle number of the current scanline. */
+	int64_t time;       /**< Master clock time that the PPU has been run up to. */
+	int64_t frameStart; /**< Master clock time when the current frame started. */
 
 	// Framebuffer
-	uint32_t* framebuffer[2]; /**< Rendered frames get drawn here. */
+	uint8_t* framebuffer[2];      /**< Rendered frames get drawn here, as NES color indices. */
+	int drawBuffer;               /**< The framebuffer that the current frame is drawn to. The other holds the last rendered frame. */
+	bool skipRendering;           /**< True if the current frame is not drawn. */
+	uint8_t lineEmphasis[2][240]; /**< The PPUMASK emphasis bits each scanline of each frame buffer was drawn with. */
+	uint32_t* argbFramebuffer;    /**< The last rendered frame converted to ARGB. */
+	int argbFrame;                /**< The frame number when argbFramebuffer was converted. */
+	uint32_t argbColors[8][64];   /**< ARGB value of each NES color index, for each combination of the emphasis bits. */
+	PPURenderMode renderMode; /**< The rendering pipeline in use. */
+
+	// Unchanged frame detection (scanline renderer only)
+	uint32_t contentVersion;      /**< Incremented whenever nametable, attribute, palette or OAM data changes. */
+	uint32_t chrVersion;          /**< Incremented whenever CHR banks are switched or CHR RAM changes. */
+	ScanlineState lineState[240]; /**< The state that each scanline was last drawn with. */
+	bool frameChanged;            /**< True if a scanline of the current frame was drawn differently from the last frame. */
+	int changedFrame;             /**< The last frame number that differed from the frame before it. */
+
+	// Background pipeline (dot renderer only)
+	uint8_t nextTile;            /**< Nametable byte fetched for the next tile. */
+	uint8_t nextAttribute;       /**< Palette number fetched for the next tile. */
+	uint8_t nextPatternLow;      /**< Low bitplane fetched for the next tile. */
+	uint8_t nextPatternHigh;     /**< High bitplane fetched for the next tile. */
+	uint16_t patternShiftLow;    /**< Low bitplane shift register for the current and next tile. */
+	uint16_t patternShiftHigh;   /**< High bitplane shift register for the current and next tile. */
+	uint16_t attributeShiftLow;  /**< Low palette bit shift register for the current and next tile. */
+	uint16_t attributeShiftHigh; /**< High palette bit shift register for the current and next tile. */
+
+	// Sprite pipeline (dot renderer only)
+	int spriteCount;                 /**< Number of sprites on the current scanline. */
+	bool spriteZeroOnLine;           /**< True if sprite 0 is the first sprite on the current scanline. */
+	uint8_t spriteX[8];              /**< Dots remaining until each sprite starts. */
+	uint8_t spriteAttributes[8];     /**< Attributes of each sprite. */
+	uint8_t spritePatternLow[8];     /**< Low bitplane shift register of each sprite. */
+	uint8_t spritePatternHigh[8];    /**< High bitplane shift register of each sprite. */
+
+	// Sprite 0 hit (scanline renderer only)
+	int64_t spriteZeroHitTime; /**< Master clock time of the next predicted sprite 0 hit, or INT64_MAX if there is none. */
+	bool spriteZeroHitStale;   /**< True if the pattern tables changed since sprite 0 hit was last predicted. */
 
 	//*****************************************************************
 	// Private Methods
@@ -146,9 +311,89 @@ private:
 	uint8_t getAttributeTableValue( uint16_t nametableAddress );
 
 	/**
-	 * Convert a nametable address to an index of the nametable.
+	 * Run the PPU forward to the current master clock time.
+	 */
+	void catchUp();
+
+	/**
+	 * Get the value (0-3) of a background pixel on the next scanline to be
+	 * drawn by the scanline renderer, using the current scroll position.
+	 */
+	uint8_t getBackgroundPixel( int x );
+
+	/**
+	 * Get the NES colors of the 4 background or sprite palettes.
+	 *
+	 * @param base 0 for the background palettes, 0x10 for the sprite palettes.
+	 * @param colors receives the colors of each pixel value of each palette.
+	 */
+	void getPaletteColors( uint8_t base, uint8_t colors[4][4] );
+
+	/**
+	 * Get the height of sprites in pixels (8 or 16).
+	 */
+	int getSpriteHeight() const;
+
+	/**
+	 * Get a row of a sprite, decoded and flipped as the sprite is drawn.
+	 *
+	 * @param sprite the sprite number in OAM, 0-63.
+	 * @param row the row of the sprite counting from the top of the screen image.
+	 */
+	uint64_t getSpriteRow( int sprite, int row );
+
+	/**
+	 * Get the pattern table tile that a row of a sprite is drawn from.
+	 *
+	 * @param sprite the sprite number in OAM, 0-63.
+	 * @param row the row of the sprite counting from the top of the screen
+	 * image. It is changed to the row within the tile.
 	 */
-	uint16_t getNametableIndex( uint16_t address );
+	uint16_t getSpriteTile( int sprite, int& row );
+
+	/**
+	 * Get a number that identifies the current contents of a pattern table
+	 * tile. It changes when the tile is written or its bank is switched
+	 * out, so anything drawn from the tile is still valid while it stays
+	 * the same.
+	 *
+	 * @param tile the tile number, 0-511.
+	 */
+	uint32_t getTileStamp( uint16_t tile );
+
+	/**
+	 * Get a row of a tile from the pattern table, decoded into one pixel
+	 * per byte.
+	 *
+	 * @param tile the tile number, 0-511.
+	 * @param row the row of the tile, 0-7.
+	 */
+	uint64_t getTileRow( uint16_t tile, int row );
+
+	/**
+	 * Expand a write to an attribute table into the palette numbers of the
+	 * 16 tiles that it covers.
+	 */
+	void expandAttributes( uint16_t address, uint8_t value );
+
+	/**
+	 * Get the nametable memory page (0-3) that a nametable address maps to.
+	 */
+	int getNametablePage( uint16_t address ) const;
+
+	/**
+	 * Get a byte of the nametable at an address, following mirroring.
+	 */
+	uint8_t& getNametableByte( uint16_t address );
+
+	/**
+	 * Predict when sprite 0 will next hit the background, and schedule an
+	 * event for it. This is done for each scanline before it is drawn, and
+	 * again after writes to PPUCTRL, PPUMASK, PPUSCROLL, PPUADDR, sprite 0
+	 * in OAM, or OAM DMA. PPUDATA writes are left out: they only happen
+	 * mid-scanline while rendering if a game corrupts the address anyway.
+	 */
+	void predictSpriteZeroHit();
 
 	/**
 	 * Read a byte from the PPU address space.
@@ -161,9 +406,113 @@ private:
 	uint8_t readDataRegister();
 
 	/**
-	 * Render a frame to the framebuffer.
+	 * Decode a row of a tile into one pixel value per byte.
+	 *
+	 * @param address the pattern table address of the row's low bitplane.
+	 */
+	uint64_t decodeTileRow( uint16_t address );
+
+	/**
+	 * Draw the current scanline into a line of the framebuffer.
+	 *
+	 * @return true if there were more than 8 sprites on the scanline.
+	 */
+	bool drawScanline( uint8_t* buffer );
+
+	/**
+	 * Evaluate and fetch the sprites for the next scanline.
+	 */
+	void evaluateSprites();
+
+	/**
+	 * Increment the coarse X scroll in the current address.
+	 */
+	void incrementScrollX();
+
+	/**
+	 * Increment the fine and coarse Y scroll in the current address.
+	 */
+	void incrementScrollY();
+
+	/**
+	 * Rebuild the resolved palette after the palette or grayscale mode changes.
+	 */
+	void resolvePalette();
+
+	/**
+	 * Read from the PPUSTATUS register.
 	 */
-	void renderFrame();
+	uint8_t readStatusRegister();
+
+	/**
+	 * Check if there are more than 8 sprites on the current scanline, when
+	 * sprites are shown.
+	 */
+	bool hasSpriteOverflow() const;
+
+	/**
+	 * Check if background or sprite rendering is enabled.
+	 */
+	bool isRenderingEnabled() const;
+
+	/**
+	 * Load the fetched tile into the low byte of the background shift registers.
+	 */
+	void loadBackgroundShifters();
+
+	/**
+	 * Output the pixel for the current dot to the framebuffer.
+	 */
+	void renderPixel();
+
+	/**
+	 * Draw the palette addresses of the background pixels of the current
+	 * scanline, starting fine X pixels before the left edge of the screen.
+	 */
+	void renderBackground( uint8_t* background );
+
+	/**
+	 * Draw the background of the current scanline like renderBackground(),
+	 * copying it out of the background cache.
+	 */
+	void renderCachedBackground( uint8_t* background );
+
+	/**
+	 * Draw a tile of a nametable page into the background cache.
+	 *
+	 * @param stamp the stamp of the pattern tile that it is drawn with.
+	 */
+	void renderCachedTile( int page, int tile, uint32_t stamp );
+
+	/**
+	 * Record the stamps of the pattern tiles that the current scanline is
+	 * drawn from, in the state that it will be drawn with.
+	 */
+	void stampScanlineTiles( ScanlineState& state );
+
+	/**
+	 * Render the current scanline to the framebuffer, using the scroll
+	 * position in the current address, then move on to the next line.
+	 */
+	void renderScanline();
+
+	/**
+	 * Run the PPU forward until it reaches a master clock time, using a
+	 * rendering pipeline.
+	 */
+	template <PPURenderMode M>
+	void run( int64_t time );
+
+	/**
+	 * Perform the work of the dot renderer for the current cycle.
+	 */
+	void stepDot();
+
+	/**
+	 * Draw the current scanline into the framebuffer, or copy it from the
+	 * last frame if it would be drawn the same way.
+	 */
+	void updateScanline();
 
 	/**
 	 * Write to PPUADDR register.
@@ -175,6 +524,11 @@ private:
 	 */
 	void writeByte( uint16_t address, uint8_t value );
 
+	/**
+	 * Write to PPUSCROLL register.
+	 */
+	void writeScrollRegister( uint8_t value );
+
 	/**
 	 * Write to PPUDATA register.
 	 */
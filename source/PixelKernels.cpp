@@ -0,0 +1,185 @@
+#include "PixelKernels.hpp"
+
+// SSE2 is part of x86-64, so its kernels are always used there. AVX2
+// kernels are built for x86 with GCC compatible compilers, and only used
+// if the CPU reports support for them at runtime.
+#if defined(__SSE2__) || defined(_M_X64)
+#define PIXEL_KERNELS_SSE2 1
+#include <emmintrin.h>
+#else
+#define PIXEL_KERNELS_SSE2 0
+#endif
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define PIXEL_KERNELS_AVX2 1
+#include <immintrin.h>
+#else
+#define PIXEL_KERNELS_AVX2 0
+#endif
+
+typedef void (*ConvertFunction)( const uint8_t* pixels, const uint32_t* colors, uint32_t* output, int count );
+
+static void convertPixelsScalar( const uint8_t* pixels, const uint32_t* colors, uint32_t* output, int count )
+{
+	for( int i = 0; i < count; i++ )
+	{
+		output[i] = colors[pixels[i]];
+	}
+}
+
+#if PIXEL_KERNELS_AVX2
+/**
+ * Convert 8 pixels at a time with a vector gather.
+ */
+__attribute__((target("avx2")))
+static void convertPixelsAVX2( const uint8_t* pixels, const uint32_t* colors, uint32_t* output, int count )
+{
+	int i = 0;
+	for( ; i + 8 <= count; i += 8 )
+	{
+		__m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pixels + i)));
+		__m256i argb = _mm256_i32gather_epi32(reinterpret_cast<const int*>(colors), indices, 4);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), argb);
+	}
+	convertPixelsScalar(pixels + i, colors, output + i, count - i);
+}
+
+/**
+ * Check if the CPU supports the AVX2 kernels.
+ */
+static bool hasAVX2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+static const ConvertFunction convertFunction = hasAVX2() ? convertPixelsAVX2 : convertPixelsScalar;
+#else
+static const ConvertFunction convertFunction = convertPixelsScalar;
+#endif
+
+#if PIXEL_KERNELS_SSE2
+/**
+ * Replace the pixels whose value is 1, 2 or 3 with the matching color.
+ */
+static inline __m128i selectColors( uint64_t tileRow, __m128i pixels, const uint8_t* colors )
+{
+	__m128i values = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&tileRow));
+	for( int value = 1; value < 4; value++ )
+	{
+		__m128i mask = _mm_cmpeq_epi8(values, _mm_set1_epi8(value));
+		__m128i color = _mm_set1_epi8(colors[value]);
+		pixels = _mm_or_si128(_mm_and_si128(mask, color), _mm_andnot_si128(mask, pixels));
+	}
+	return pixels;
+}
+#endif
+
+void combinePixels( const uint8_t* background, const uint8_t* sprites, const uint8_t* palette, uint8_t* output, int count )
+{
+#if PIXEL_KERNELS_SSE2
+	// Select the palette address of each pixel 16 at a time, then look up
+	// the colors
+	const __m128i zero = _mm_setzero_si128();
+	for( int x = 0; x < count; x += 16 )
+	{
+		__m128i backgroundPixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(background + x));
+		__m128i spritePixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sprites + x));
+
+		// Sprites are drawn where they are opaque, and either in front or
+		// over a transparent background
+		__m128i noSprite = _mm_cmpeq_epi8(spritePixels, zero);
+		__m128i inFront = _mm_cmpeq_epi8(_mm_and_si128(spritePixels, _mm_set1_epi8(static_cast<char>(0x80))), zero);
+		__m128i transparent = _mm_cmpeq_epi8(backgroundPixels, zero);
+		__m128i useSprite = _mm_andnot_si128(noSprite, _mm_or_si128(inFront, transparent));
+
+		__m128i spriteAddresses = _mm_and_si128(spritePixels, _mm_set1_epi8(0x1f));
+		__m128i addresses = _mm_or_si128(_mm_and_si128(useSprite, spriteAddresses), _mm_andnot_si128(useSprite, backgroundPixels));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(output + x), addresses);
+	}
+	for( int x = 0; x < count; x++ )
+	{
+		output[x] = palette[output[x]];
+	}
+#else
+	for( int x = 0; x < count; x++ )
+	{
+		uint8_t address = background[x];
+		uint8_t sprite = sprites[x];
+		if( sprite != 0 && (address == 0 || !(sprite & BIT_7)) )
+		{
+			address = sprite & 0x1f;
+		}
+		output[x] = palette[address];
+	}
+#endif
+}
+
+void convertPixels( const uint8_t* pixels, const uint32_t* colors, uint32_t* output, int count )
+{
+	convertFunction(pixels, colors, output, count);
+}
+
+void expandBackground( const uint64_t* tileRows, const uint8_t* palettes, uint8_t* pixels, int count )
+{
+	// Opaque pixels select a color from the tile's palette, at address
+	// palette * 4 + value. Transparent pixels stay 0.
+	int i = 0;
+#if PIXEL_KERNELS_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for( ; i + 2 <= count; i += 2 )
+	{
+		__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tileRows + i));
+		__m128i bases = _mm_unpacklo_epi64(_mm_set1_epi8(palettes[i] << 2), _mm_set1_epi8(palettes[i + 1] << 2));
+		__m128i transparent = _mm_cmpeq_epi8(values, zero);
+		__m128i addresses = _mm_or_si128(values, _mm_andnot_si128(transparent, bases));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + i * 8), addresses);
+	}
+#endif
+	for( ; i < count; i++ )
+	{
+		for( int column = 0; column < 8; column++ )
+		{
+			uint8_t value = (tileRows[i] >> (column * 8)) & 0x3;
+			pixels[i * 8 + column] = (value != 0) ? (value | (palettes[i] << 2)) : 0;
+		}
+	}
+}
+
+void expandTileRow( uint64_t tileRow, const uint8_t* colors, uint8_t* pixels )
+{
+#if PIXEL_KERNELS_SSE2
+	__m128i background = _mm_set1_epi8(colors[0]);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(pixels), selectColors(tileRow, background, colors));
+#else
+	for( int column = 0; column < 8; column++ )
+	{
+		pixels[column] = colors[(tileRow >> (column * 8)) & 0x3];
+	}
+#endif
+}
+
+void expandTileRowTransparent( uint64_t tileRow, const uint8_t* colors, uint8_t* pixels )
+{
+#if PIXEL_KERNELS_SSE2
+	__m128i* destination = reinterpret_cast<__m128i*>(pixels);
+	_mm_storel_epi64(destination, selectColors(tileRow, _mm_loadl_epi64(destination), colors));
+#else
+	for( int column = 0; column < 8; column++ )
+	{
+		uint8_t value = (tileRow >> (column * 8)) & 0x3;
+		if( value != 0 )
+		{
+			pixels[column] = colors[value];
+		}
+	}
+#endif
+}
+
+uint64_t flipTileRow( uint64_t tileRow )
+{
+	// Reverse the order of the bytes
+	tileRow = ((tileRow & 0x00ff00ff00ff00ffULL) << 8) | ((tileRow >> 8) & 0x00ff00ff00ff00ffULL);
+	tileRow = ((tileRow & 0x0000ffff0000ffffULL) << 16) | ((tileRow >> 16) & 0x0000ffff0000ffffULL);
+	return (tileRow << 32) | (tileRow >> 32);
+}
@@ -0,0 +1,62 @@
+#ifndef PIXEL_KERNELS_HPP
+#define PIXEL_KERNELS_HPP
+
+#include "Types.hpp"
+
+/**
+ * Combine a line of background and sprite pixels by priority, and look up
+ * the color of each pixel.
+ *
+ * @param background the palette address of each background pixel, 0 where
+ * it is transparent.
+ * @param sprites the palette address of each sprite pixel, with BIT_7 set
+ * for sprites behind the background, 0 where there is no sprite.
+ * @param palette the color index drawn for each palette address.
+ * @param output where the color indices are written.
+ * @param count the number of pixels, a multiple of 16.
+ */
+void combinePixels( const uint8_t* background, const uint8_t* sprites, const uint8_t* palette, uint8_t* output, int count );
+
+/**
+ * Convert indexed pixels to ARGB.
+ *
+ * @param pixels the indexed pixels.
+ * @param colors the ARGB color of each index.
+ * @param output where the ARGB pixels are written.
+ * @param count the number of pixels to convert.
+ */
+void convertPixels( const uint8_t* pixels, const uint32_t* colors, uint32_t* output, int count );
+
+/**
+ * Expand a line of decoded background tile rows to the palette address of
+ * each pixel, 0 where the pixel is transparent.
+ *
+ * @param tileRows the row of each tile, as returned by the tile cache.
+ * @param palettes the palette number (0-3) of each tile.
+ * @param pixels where 8 pixels for each tile are written.
+ * @param count the number of tiles.
+ */
+void expandBackground( const uint64_t* tileRows, const uint8_t* palettes, uint8_t* pixels, int count );
+
+/**
+ * Expand a decoded tile row to 8 indexed pixels.
+ *
+ * @param tileRow the tile row, with one pixel value (0-3) per byte and
+ * the leftmost pixel in the low byte.
+ * @param colors the 4 color indices that the pixel values select.
+ * @param pixels where the 8 pixels are written.
+ */
+void expandTileRow( uint64_t tileRow, const uint8_t* colors, uint8_t* pixels );
+
+/**
+ * Expand a decoded tile row to 8 indexed pixels, leaving the destination
+ * unchanged where the pixel value is 0 (transparent).
+ */
+void expandTileRowTransparent( uint64_t tileRow, const uint8_t* colors, uint8_t* pixels );
+
+/**
+ * Mirror a decoded tile row horizontally.
+ */
+uint64_t flipTileRow( uint64_t tileRow );
+
+#endif // PIXEL_KERNELS_HPP
@@ -0,0 +1,48 @@
+#include "Scheduler.hpp"
+
+Scheduler::Scheduler() :
+	clock(0)
+{
+	for( auto& time : eventTimes )
+	{
+		time = INT64_MAX;
+	}
+}
+
+void Scheduler::advance( int cycles )
+{
+	clock += cycles;
+}
+
+void Scheduler::cancel( SchedulerEvent event )
+{
+	eventTimes[event] = INT64_MAX;
+}
+
+int64_t Scheduler::getClock() const
+{
+	return clock;
+}
+
+SchedulerEvent Scheduler::getNextEvent() const
+{
+	int next = 0;
+	for( int i = 1; i < EVENT_COUNT; i++ )
+	{
+		if( eventTimes[i] < eventTimes[next] )
+		{
+			next = i;
+		}
+	}
+	return (SchedulerEvent)next;
+}
+
+int64_t Scheduler::getNextEventTime() const
+{
+	return eventTimes[getNextEvent()];
+}
+
+void Scheduler::schedule( SchedulerEvent event, int64_t time )
+{
+	eventTimes[event] = time;
+}
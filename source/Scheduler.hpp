@@ -0,0 +1,65 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include "Types.hpp"
+
+/**
+ * Timing events that can be scheduled.
+ */
+enum SchedulerEvent
+{
+	EVENT_VBLANK,          /**< The PPU enters vblank and may raise an NMI. */
+	EVENT_FRAME_END,       /**< The PPU finishes the current frame. */
+	EVENT_SPRITE_ZERO_HIT, /**< The PPU sets the sprite 0 hit flag. */
+	EVENT_MAPPER_IRQ,      /**< The mapper's scanline counter may raise an IRQ. */
+
+	EVENT_COUNT
+};
+
+/**
+ * Keeps the master clock and the times of upcoming timing events.
+ *
+ * All times are measured in PPU cycles (3 per CPU cycle).
+ */
+class Scheduler
+{
+public:
+	Scheduler();
+
+	/**
+	 * Advance the master clock.
+	 */
+	void advance( int cycles );
+
+	/**
+	 * Remove an event from the schedule.
+	 */
+	void cancel( SchedulerEvent event );
+
+	/**
+	 * Get the current time of the master clock.
+	 */
+	int64_t getClock() const;
+
+	/**
+	 * Get the event that will happen first.
+	 */
+	SchedulerEvent getNextEvent() const;
+
+	/**
+	 * Get the time of the event that will happen first.
+	 */
+	int64_t getNextEventTime() const;
+
+	/**
+	 * Schedule an event to happen at a given time, replacing any previous
+	 * time for the same event.
+	 */
+	void schedule( SchedulerEvent event, int64_t time );
+
+private:
+	int64_t clock;                   /**< The master clock. */
+	int64_t eventTimes[EVENT_COUNT]; /**< The time of each event, or INT64_MAX if it isn't scheduled. */
+};
+
+#endif // SCHEDULER_HPP
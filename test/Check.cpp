@@ -0,0 +1,1307 @@
+/**
+ * @file
+ * Headless regression check for the emulator core.
+ *
+ * Builds small test ROMs in memory and runs each of them with every
+ * combination of execution mode and PPU option. RAM and the framebuffer are
+ * checksummed every few frames and must match the interpreter, whose
+ * framebuffer checksum must match a known good one. The test ROMs also leave
+ * the results of their mapper tests in RAM, which are checked against the
+ * values they should have.
+ *
+ * ROM files given on the command line are run the same way, without any
+ * expected values.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "NES.hpp"
+
+/**
+ * Number of frames that each test ROM is run for.
+ */
+static const int FRAME_COUNT = 60;
+
+/**
+ * Number of frames that ROM files are run for, long enough to get past the
+ * title screen of most games.
+ */
+static const int ROM_FILE_FRAME_COUNT = 300;
+
+/**
+ * Number of frames between checksums of RAM and the framebuffer.
+ */
+static const int CHECKSUM_INTERVAL = 10;
+
+//*********************************************************************
+// Emulator configurations
+//*********************************************************************
+
+/**
+ * A combination of emulator options that a ROM is run with.
+ */
+struct Configuration
+{
+	const char* name;
+	ExecutionMode executionMode;
+	PPURenderMode renderMode;
+	bool backgroundCache;
+	int renderInterval; /**< Only one of every N frames is drawn. */
+};
+
+/**
+ * The configurations to check. The first one is the reference that the
+ * others are compared with. The first configuration with the dot renderer is
+ * the reference for the others that use it, for ROMs with mid-scanline effects.
+ */
+static const Configuration configurations[] =
+{
+	{ "interpreter",                 EXECUTION_INTERPRETER, RENDER_SCANLINE, false, 1 },
+	{ "translator",                  EXECUTION_TRANSLATOR,  RENDER_SCANLINE, false, 1 },
+	{ "verify",                      EXECUTION_VERIFY,      RENDER_SCANLINE, false, 1 },
+	{ "background cache",            EXECUTION_INTERPRETER, RENDER_SCANLINE, true,  1 },
+	{ "translator, background cache", EXECUTION_TRANSLATOR,  RENDER_SCANLINE, true,  1 },
+	{ "render every 2",              EXECUTION_TRANSLATOR,  RENDER_SCANLINE, true,  2 },
+	{ "accurate PPU",                EXECUTION_INTERPRETER, RENDER_DOT,      false, 1 },
+	{ "accurate PPU, translator",    EXECUTION_TRANSLATOR,  RENDER_DOT,      false, 1 }
+};
+
+static const int CONFIGURATION_COUNT = sizeof(configurations) / sizeof(configurations[0]);
+
+//*********************************************************************
+// Test ROM construction
+//*********************************************************************
+
+/**
+ * 6502 opcodes used by the test ROMs.
+ */
+enum Opcode
+{
+	ADC_IMM = 0x69,
+	AND_IMM = 0x29,
+	ASL     = 0x0a,
+	BCC     = 0x90,
+	BEQ     = 0xf0,
+	BIT_ABS = 0x2c,
+	BNE     = 0xd0,
+	BPL     = 0x10,
+	BVC     = 0x50,
+	BVS     = 0x70,
+	CLC     = 0x18,
+	CLD     = 0xd8,
+	CLI     = 0x58,
+	CPY_IMM = 0xc0,
+	DEY     = 0x88,
+	INC_ZP  = 0xe6,
+	INX     = 0xe8,
+	INY     = 0xc8,
+	JMP_ABS = 0x4c,
+	JSR     = 0x20,
+	LDA_IMM = 0xa9,
+	LDA_ZP  = 0xa5,
+	LDA_ABS = 0xad,
+	LDA_ABX = 0xbd,
+	LDX_IMM = 0xa2,
+	LDY_IMM = 0xa0,
+	LSR     = 0x4a,
+	ORA_IMM = 0x09,
+	PHA     = 0x48,
+	PLA     = 0x68,
+	RTI     = 0x40,
+	RTS     = 0x60,
+	SEI     = 0x78,
+	STA_ZP  = 0x85,
+	STA_ABS = 0x8d,
+	STA_ABX = 0x9d,
+	TXA     = 0x8a,
+	TXS     = 0x9a,
+	TYA     = 0x98
+};
+
+/**
+ * Builds an iNES ROM image, and assembles 6502 code into its PRG ROM.
+ */
+class ROMBuilder
+{
+public:
+	/**
+	 * @param prgPages number of 16kb PRG ROM pages.
+	 * @param chrPages number of 8kb CHR ROM pages, or 0 for CHR RAM.
+	 * @param mirroring the header's mirroring flags.
+	 */
+	ROMBuilder( int mapper, int prgPages, int chrPages, uint8_t mirroring );
+
+	uint8_t* getPrg();
+	uint8_t* getChr();
+
+	/**
+	 * Get the CPU address that the next instruction is assembled at.
+	 */
+	uint16_t getAddress() const;
+
+	/**
+	 * Set where the following code is assembled.
+	 *
+	 * @param offset the offset in PRG ROM.
+	 * @param address the CPU address that the offset is mapped to.
+	 */
+	void setOrigin( int offset, uint16_t address );
+
+	/**
+	 * Set the interrupt vectors at the end of PRG ROM.
+	 */
+	void setVectors( uint16_t nmi, uint16_t reset, uint16_t irq );
+
+	void implied( Opcode opcode );
+	void immediate( Opcode opcode, uint8_t value );
+	void zeroPage( Opcode opcode, uint8_t address );
+	void absolute( Opcode opcode, uint16_t address );
+	void branch( Opcode opcode, uint16_t target );
+
+	/**
+	 * Store an immediate value to an address with LDA and STA.
+	 */
+	void store( uint16_t address, uint8_t value );
+
+	/**
+	 * Get the complete ROM image.
+	 */
+	std::vector<uint8_t> build() const;
+
+private:
+	uint8_t header[16];
+	std::vector<uint8_t> prg;
+	std::vector<uint8_t> chr;
+
+	int offset;       /**< The PRG ROM offset that the next byte is assembled at. */
+	int originOffset; /**< The PRG ROM offset of the origin. */
+	uint16_t origin;  /**< The CPU address of the origin. */
+
+	void emit( std::initializer_list<int> bytes );
+};
+
+ROMBuilder::ROMBuilder( int mapper, int prgPages, int chrPages, uint8_t mirroring ) :
+	header{ 'N', 'E', 'S', 0x1a },
+	prg(prgPages * 0x4000, 0),
+	chr(chrPages * 0x2000, 0),
+	offset(0),
+	originOffset(0),
+	origin(0x8000)
+{
+	header[4] = prgPages;
+	header[5] = chrPages;
+	header[6] = ((mapper & 0x0f) << 4) | mirroring;
+	header[7] = mapper & 0xf0;
+	for( int i = 8; i < 16; i++ )
+	{
+		header[i] = 0;
+	}
+}
+
+uint8_t* ROMBuilder::getPrg()
+{
+	return prg.data();
+}
+
+uint8_t* ROMBuilder::getChr()
+{
+	return chr.data();
+}
+
+uint16_t ROMBuilder::getAddress() const
+{
+	return origin + (offset - originOffset);
+}
+
+void ROMBuilder::setOrigin( int offset, uint16_t address )
+{
+	this->offset = offset;
+	originOffset = offset;
+	origin = address;
+}
+
+void ROMBuilder::setVectors( uint16_t nmi, uint16_t reset, uint16_t irq )
+{
+	size_t vectors = prg.size() - 6;
+	uint16_t addresses[3] = { nmi, reset, irq };
+	for( int i = 0; i < 3; i++ )
+	{
+		prg[vectors + i * 2] = addresses[i] & 0xff;
+		prg[vectors + i * 2 + 1] = addresses[i] >> 8;
+	}
+}
+
+void ROMBuilder::emit( std::initializer_list<int> bytes )
+{
+	for( int byte : bytes )
+	{
+		prg[offset++] = byte & 0xff;
+	}
+}
+
+void ROMBuilder::implied( Opcode opcode )
+{
+	emit({ opcode });
+}
+
+void ROMBuilder::immediate( Opcode opcode, uint8_t value )
+{
+	emit({ opcode, value });
+}
+
+void ROMBuilder::zeroPage( Opcode opcode, uint8_t address )
+{
+	emit({ opcode, address });
+}
+
+void ROMBuilder::absolute( Opcode opcode, uint16_t address )
+{
+	emit({ opcode, address & 0xff, address >> 8 });
+}
+
+void ROMBuilder::branch( Opcode opcode, uint16_t target )
+{
+	emit({ opcode, target - (getAddress() + 2) });
+}
+
+void ROMBuilder::store( uint16_t address, uint8_t value )
+{
+	immediate(LDA_IMM, value);
+	absolute(STA_ABS, address);
+}
+
+std::vector<uint8_t> ROMBuilder::build() const
+{
+	std::vector<uint8_t> image(header, header + sizeof(header));
+	image.insert(image.end(), prg.begin(), prg.end());
+	image.insert(image.end(), chr.begin(), chr.end());
+	return image;
+}
+
+/**
+ * A test ROM and the RAM values it should leave.
+ */
+struct TestCase
+{
+	std::string name;
+	std::vector<uint8_t> image;
+	std::vector<std::pair<uint16_t, uint8_t> > expected; /**< Address and value of each RAM byte to check. */
+	int frameCount;         /**< Number of frames to run. */
+	bool exactScanlines;    /**< True if the ROM runs and is drawn identically with the scanline and dot renderers. */
+	uint32_t frameChecksum; /**< Expected framebuffer checksum in the first configuration, or 0 if unknown. */
+	bool staticFrames;      /**< True if the ROM stops changing what it shows, so the scanline renderer should report unchanged frames. */
+
+	TestCase() :
+		frameCount(FRAME_COUNT),
+		exactScanlines(true),
+		frameChecksum(0),
+		staticFrames(false)
+	{
+	}
+};
+
+/**
+ * Add expected RAM values at consecutive addresses.
+ */
+static void expect( TestCase& test, uint16_t address, std::initializer_list<int> values )
+{
+	for( int value : values )
+	{
+		test.expected.push_back(std::make_pair(address++, (uint8_t)value));
+	}
+}
+
+/**
+ * Initialize the CPU: disable interrupts and decimal mode, and set up the stack.
+ */
+static void emitReset( ROMBuilder& rom )
+{
+	rom.implied(SEI);
+	rom.implied(CLD);
+	rom.immediate(LDX_IMM, 0xff);
+	rom.implied(TXS);
+}
+
+/**
+ * Set the PPU address for PPUDATA accesses.
+ */
+static void emitPPUAddress( ROMBuilder& rom, uint16_t address )
+{
+	rom.store(0x2006, address >> 8);
+	rom.store(0x2006, address & 0xff);
+}
+
+/**
+ * Write colors to the start of the palette.
+ */
+static void emitPalette( ROMBuilder& rom, std::initializer_list<int> colors )
+{
+	emitPPUAddress(rom, 0x3f00);
+	for( int color : colors )
+	{
+		rom.store(0x2007, color);
+	}
+}
+
+/**
+ * Write a value to an MMC1 register through its serial port. The value is
+ * taken from the accumulator unless one is given.
+ */
+static void emitMMC1Write( ROMBuilder& rom, uint16_t address, int value = -1 )
+{
+	if( value >= 0 )
+	{
+		rom.immediate(LDA_IMM, value);
+	}
+	for( int bit = 0; bit < 5; bit++ )
+	{
+		rom.absolute(STA_ABS, address);
+		if( bit < 4 )
+		{
+			rom.implied(LSR);
+		}
+	}
+}
+
+/**
+ * MMC1 PRG banking in each mode, PRG RAM enable, bank switches from code
+ * running in RAM, and either CHR RAM or 4kb CHR ROM bank switches each frame.
+ */
+static TestCase buildMMC1( bool chrRAM )
+{
+	ROMBuilder rom(1, 8, chrRAM ? 0 : 2, 0);
+
+	// Each bank starts with its number and a routine that returns it plus $40
+	for( int bank = 0; bank < 8; bank++ )
+	{
+		uint8_t* data = rom.getPrg() + bank * 0x4000;
+		data[0] = bank;
+		data[1] = LDA_IMM;
+		data[2] = 0x40 + bank;
+		data[3] = RTS;
+	}
+
+	// Control: switch the $8000 bank, vertical mirroring, 8kb or 4kb CHR
+	// banks. Clearing bit 3 selects 32kb mode, and bit 2 fixes the first bank.
+	uint8_t control = chrRAM ? 0x0e : 0x1e;
+
+	rom.setOrigin(7 * 0x4000 + 0x100, 0xc100);
+	uint16_t reset = rom.getAddress();
+	emitReset(rom);
+	rom.store(0x8000, 0x80);
+	emitMMC1Write(rom, 0x8000, control);
+	for( int bank = 0; bank < 7; bank++ )
+	{
+		emitMMC1Write(rom, 0xe000, bank);
+		rom.absolute(LDA_ABS, 0x8000);
+		rom.zeroPage(STA_ZP, bank);
+		rom.absolute(JSR, 0x8001);
+		rom.zeroPage(STA_ZP, 0x08 + bank);
+	}
+
+	// PRG RAM reads back what was written, and nothing while disabled
+	rom.store(0x6000, 0x5a);
+	rom.absolute(LDA_ABS, 0x6000);
+	rom.zeroPage(STA_ZP, 0x10);
+	emitMMC1Write(rom, 0xe000, 0x10);
+	rom.absolute(LDA_ABS, 0x6000);
+	rom.zeroPage(STA_ZP, 0x11);
+	emitMMC1Write(rom, 0xe000, 0x00);
+	rom.absolute(LDA_ABS, 0x6000);
+	rom.zeroPage(STA_ZP, 0x12);
+
+	// Copy the routine at $c800 to $0300 and run it from RAM
+	rom.immediate(LDX_IMM, 0x00);
+	uint16_t copy = rom.getAddress();
+	rom.absolute(LDA_ABX, 0xc800);
+	rom.absolute(STA_ABX, 0x0300);
+	rom.implied(INX);
+	rom.branch(BNE, copy);
+	rom.absolute(JSR, 0x0300);
+
+	rom.absolute(LDA_ABS, 0x2002);
+	emitPalette(rom, { 0x0f, 0x16, 0x2a, 0x12 });
+	if( chrRAM )
+	{
+		// Tile 1 is a checkerboard in the low plane and stripes in the high plane
+		emitPPUAddress(rom, 0x0010);
+		for( int row = 0; row < 8; row++ )
+		{
+			rom.store(0x2007, (row % 2) ? 0x55 : 0xaa);
+		}
+		for( int row = 0; row < 8; row++ )
+		{
+			rom.store(0x2007, 0xf0);
+		}
+
+		// Read it back
+		emitPPUAddress(rom, 0x0010);
+		rom.absolute(LDA_ABS, 0x2007);
+		rom.absolute(LDA_ABS, 0x2007);
+		rom.zeroPage(STA_ZP, 0x13);
+	}
+
+	// Fill two pages of the nametable with tile 1 for CHR RAM, or tiles 0-15
+	emitPPUAddress(rom, 0x2000);
+	rom.immediate(LDY_IMM, 0x02);
+	uint16_t page = rom.getAddress();
+	rom.immediate(LDX_IMM, 0x00);
+	uint16_t tile = rom.getAddress();
+	if( chrRAM )
+	{
+		rom.immediate(LDA_IMM, 0x01);
+	}
+	else
+	{
+		rom.implied(TXA);
+		rom.immediate(AND_IMM, 0x0f);
+	}
+	rom.absolute(STA_ABS, 0x2007);
+	rom.implied(INX);
+	rom.branch(BNE, tile);
+	rom.implied(DEY);
+	rom.branch(BNE, page);
+
+	rom.store(0x2005, 0x00);
+	rom.absolute(STA_ABS, 0x2005);
+	rom.store(0x2001, 0x0a);
+	rom.store(0x2000, 0x80);
+	uint16_t loop = rom.getAddress();
+	rom.absolute(JMP_ABS, loop);
+
+	// NMI: count frames, and switch the first CHR ROM bank every 16 frames
+	uint16_t nmi = rom.getAddress();
+	rom.zeroPage(INC_ZP, 0x30);
+	if( !chrRAM )
+	{
+		rom.zeroPage(LDA_ZP, 0x30);
+		for( int i = 0; i < 4; i++ )
+		{
+			rom.implied(LSR);
+		}
+		rom.immediate(AND_IMM, 0x03);
+		emitMMC1Write(rom, 0xa000);
+	}
+	rom.store(0x2005, 0x00);
+	rom.absolute(STA_ABS, 0x2005);
+	rom.implied(RTI);
+
+	// The routine run from RAM checks the 32kb and fixed first bank modes
+	rom.setOrigin(7 * 0x4000 + 0x800, 0xc800);
+	emitMMC1Write(rom, 0x8000, control & 0x12);
+	emitMMC1Write(rom, 0xe000, 0x04);
+	rom.absolute(LDA_ABS, 0x8000);
+	rom.zeroPage(STA_ZP, 0x20);
+	rom.absolute(LDA_ABS, 0xc000);
+	rom.zeroPage(STA_ZP, 0x21);
+	emitMMC1Write(rom, 0x8000, control & 0x1a);
+	emitMMC1Write(rom, 0xe000, 0x03);
+	rom.absolute(LDA_ABS, 0x8000);
+	rom.zeroPage(STA_ZP, 0x22);
+	rom.absolute(LDA_ABS, 0xc000);
+	rom.zeroPage(STA_ZP, 0x23);
+	emitMMC1Write(rom, 0x8000, control);
+	emitMMC1Write(rom, 0xe000, 0x00);
+	rom.implied(RTS);
+
+	rom.setVectors(nmi, reset, 0);
+
+	// CHR ROM has four 4kb banks, each with a different pattern
+	if( !chrRAM )
+	{
+		static const uint8_t patterns[4] = { 0xff, 0x81, 0xaa, 0x0f };
+		for( int bank = 0; bank < 4; bank++ )
+		{
+			for( int tile = 0; tile < 16; tile++ )
+			{
+				for( int row = 0; row < 8; row++ )
+				{
+					uint8_t* data = rom.getChr() + bank * 0x1000 + tile * 16;
+					data[row] = (row <= tile % 8) ? patterns[bank] : 0;
+					data[row + 8] = (bank & 1) ? 0xff : 0;
+				}
+			}
+		}
+	}
+
+	TestCase test;
+	test.name = chrRAM ? "MMC1 CHR RAM" : "MMC1 CHR ROM";
+	test.image = rom.build();
+	expect(test, 0x00, { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06 });
+	expect(test, 0x08, { 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46 });
+	expect(test, 0x10, { 0x5a, 0x00, 0x5a });
+	expect(test, 0x20, { 0x04, 0x05, 0x00, 0x03 });
+	expect(test, 0x30, { FRAME_COUNT - 1 });
+	test.frameChecksum = chrRAM ? 0xa93d9509 : 0xd0039a05;
+	return test;
+}
+
+/**
+ * MMC3 PRG banking in both modes, PRG RAM protection, and scanline IRQs
+ * that change the scroll position. The IRQ counter is either reloaded once
+ * a frame, or from the IRQ handler as well.
+ */
+static TestCase buildMMC3( bool reloadInIRQ )
+{
+	ROMBuilder rom(4, 4, 2, 0);
+
+	for( int bank = 0; bank < 8; bank++ )
+	{
+		uint8_t* data = rom.getPrg() + bank * 0x2000;
+		data[0] = bank;
+		data[1] = LDA_IMM;
+		data[2] = 0x40 + bank;
+		data[3] = RTS;
+	}
+
+	rom.setOrigin(7 * 0x2000 + 0x100, 0xe100);
+	uint16_t reset = rom.getAddress();
+	emitReset(rom);
+
+	// PRG mode 0: R6 is at $8000
+	for( int bank = 0; bank < 6; bank++ )
+	{
+		rom.store(0x8000, 6);
+		rom.store(0x8001, bank);
+		rom.absolute(LDA_ABS, 0x8000);
+		rom.zeroPage(STA_ZP, bank);
+		rom.absolute(JSR, 0x8001);
+		rom.zeroPage(STA_ZP, 0x08 + bank);
+	}
+	rom.store(0x8000, 7);
+	rom.store(0x8001, 3);
+	rom.absolute(LDA_ABS, 0xa000);
+	rom.zeroPage(STA_ZP, 0x06);
+	rom.absolute(LDA_ABS, 0xc000);
+	rom.zeroPage(STA_ZP, 0x07);
+
+	// PRG mode 1: R6 is at $c000 and the second last bank at $8000
+	rom.store(0x8000, 0x46);
+	rom.store(0x8001, 2);
+	rom.absolute(LDA_ABS, 0x8000);
+	rom.zeroPage(STA_ZP, 0x10);
+	rom.absolute(LDA_ABS, 0xc000);
+	rom.zeroPage(STA_ZP, 0x11);
+	rom.store(0x8000, 0x06);
+	rom.store(0x8001, 0);
+
+	// PRG RAM: enabled, write protected, disabled and enabled again
+	rom.store(0x6000, 0x5a);
+	rom.absolute(LDA_ABS, 0x6000);
+	rom.zeroPage(STA_ZP, 0x12);
+	rom.store(0xa001, 0xc0);
+	rom.store(0x6000, 0x33);
+	rom.absolute(LDA_ABS, 0x6000);
+	rom.zeroPage(STA_ZP, 0x13);
+	rom.store(0xa001, 0x00);
+	rom.absolute(LDA_ABS, 0x6000);
+	rom.zeroPage(STA_ZP, 0x14);
+	rom.store(0xa001, 0x80);
+	rom.absolute(LDA_ABS, 0x6000);
+	rom.zeroPage(STA_ZP, 0x15);
+
+	// CHR: 2kb banks 0 and 2, and vertical mirroring
+	rom.store(0x8000, 0);
+	rom.store(0x8001, 0);
+	rom.store(0x8000, 1);
+	rom.store(0x8001, 2);
+	rom.store(0xa000, 0);
+
+	// Wait for vblank, then fill the nametables with tiles 0-63
+	rom.absolute(LDA_ABS, 0x2002);
+	uint16_t wait = rom.getAddress();
+	rom.absolute(LDA_ABS, 0x2002);
+	rom.branch(BPL, wait);
+	emitPalette(rom, { 0x0f, 0x16, 0x2a, 0x12 });
+	emitPPUAddress(rom, 0x2000);
+	rom.immediate(LDY_IMM, 0x04);
+	uint16_t page = rom.getAddress();
+	rom.immediate(LDX_IMM, 0x00);
+	uint16_t tile = rom.getAddress();
+	rom.implied(TXA);
+	rom.immediate(AND_IMM, 0x3f);
+	rom.absolute(STA_ABS, 0x2007);
+	rom.implied(INX);
+	rom.branch(BNE, tile);
+	rom.implied(DEY);
+	rom.branch(BNE, page);
+
+	rom.store(0x2005, 0x00);
+	rom.absolute(STA_ABS, 0x2005);
+	rom.store(0x2001, 0x0a);
+	rom.store(0x2000, 0x88);
+	rom.implied(CLI);
+	uint16_t loop = rom.getAddress();
+	rom.zeroPage(INC_ZP, 0x22);
+	rom.absolute(JMP_ABS, loop);
+
+	// NMI: record the IRQs taken last frame and restart the IRQ counter
+	uint16_t nmi = rom.getAddress();
+	rom.implied(PHA);
+	rom.zeroPage(LDA_ZP, 0x21);
+	rom.zeroPage(STA_ZP, 0x26);
+	rom.immediate(LDA_IMM, 0x00);
+	rom.zeroPage(STA_ZP, 0x21);
+	rom.zeroPage(STA_ZP, 0x27);
+	rom.store(0xc000, 20);
+	rom.store(0xc001, 0);
+	rom.store(0xe001, 0);
+	rom.store(0x2005, 0x00);
+	rom.absolute(STA_ABS, 0x2005);
+	rom.zeroPage(INC_ZP, 0x30);
+	rom.implied(PLA);
+	rom.implied(RTI);
+
+	// IRQ: acknowledge, count, and scroll the rest of the screen further
+	uint16_t irq = rom.getAddress();
+	rom.implied(PHA);
+	rom.store(0xe000, 0);
+	rom.store(0xe001, 0);
+	if( reloadInIRQ )
+	{
+		rom.store(0xc000, 10);
+		rom.store(0xc001, 0);
+	}
+	rom.zeroPage(INC_ZP, 0x20);
+	rom.zeroPage(INC_ZP, 0x21);
+	rom.zeroPage(LDA_ZP, 0x27);
+	rom.implied(CLC);
+	rom.immediate(ADC_IMM, 0x10);
+	rom.zeroPage(STA_ZP, 0x27);
+	rom.absolute(STA_ABS, 0x2005);
+	rom.absolute(STA_ABS, 0x2005);
+	rom.implied(PLA);
+	rom.implied(RTI);
+
+	rom.setVectors(nmi, reset, irq);
+
+	// CHR ROM has a different pattern in each 1kb bank
+	static const uint8_t patterns[4] = { 0xff, 0x81, 0xaa, 0x0f };
+	for( int bank = 0; bank < 16; bank++ )
+	{
+		for( int tile = 0; tile < 64; tile++ )
+		{
+			for( int row = 0; row < 8; row++ )
+			{
+				uint8_t* data = rom.getChr() + bank * 0x400 + tile * 16;
+				data[row] = (row <= tile % 8) ? patterns[bank % 4] : 0;
+				data[row + 8] = (bank & 4) ? 0xff : 0;
+			}
+		}
+	}
+
+	TestCase test;
+	test.name = reloadInIRQ ? "MMC3 IRQ reload" : "MMC3";
+	test.image = rom.build();
+	expect(test, 0x00, { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x03, 0x06 });
+	expect(test, 0x08, { 0x40, 0x41, 0x42, 0x43, 0x44, 0x45 });
+	expect(test, 0x10, { 0x06, 0x02, 0x5a, 0x5a, 0x00, 0x5a });
+	expect(test, 0x26, { reloadInIRQ ? 21 : 11 });
+	expect(test, 0x30, { FRAME_COUNT - 2 });
+	test.frameChecksum = reloadInIRQ ? 0xc1e4c2a6 : 0x4699b504;
+	return test;
+}
+
+/**
+ * PRG and CHR bank switches of a discrete logic mapper, including a write
+ * that conflicts with the ROM contents on the bus.
+ *
+ * @param values the bank register values to test.
+ * @param banks the PRG bank numbers and CHR bytes that should be read back.
+ */
+static TestCase buildDiscrete( const char* name, int mapper, int chrPages, std::initializer_list<int> values, std::initializer_list<int> banks )
+{
+	ROMBuilder rom(mapper, 8, chrPages, 0);
+
+	// The program is in the last page, at $c000 when it is switched to $8000
+	// as well as when it is fixed there. $f000-$f0ff holds each byte value,
+	// to write bank numbers without bus conflicts.
+	uint8_t* program = rom.getPrg() + 7 * 0x4000;
+	for( int value = 0; value < 0x100; value++ )
+	{
+		program[0x3000 + value] = value;
+	}
+
+	rom.setOrigin(7 * 0x4000 + 0x100, 0xc100);
+	uint16_t reset = rom.getAddress();
+	emitReset(rom);
+	rom.absolute(LDA_ABS, 0x2002);
+
+	// Record the number of the banks at $8000 and $c000 and the first CHR byte
+	uint8_t result = 0;
+	std::vector<int> writes(values);
+	writes.push_back(-1);
+	for( int value : writes )
+	{
+		if( value >= 0 )
+		{
+			rom.store(0xf000 + value, value);
+		}
+		else
+		{
+			// Write $ff where the ROM holds $01
+			rom.store(0xf001, 0xff);
+		}
+		rom.absolute(LDA_ABS, 0x8000);
+		rom.zeroPage(STA_ZP, result++);
+		rom.absolute(LDA_ABS, 0xc000);
+		rom.zeroPage(STA_ZP, result++);
+		rom.immediate(LDA_IMM, 0x00);
+		rom.absolute(STA_ABS, 0x2006);
+		rom.absolute(STA_ABS, 0x2006);
+		rom.absolute(LDA_ABS, 0x2007);
+		rom.zeroPage(STA_ZP, result++);
+	}
+	uint16_t loop = rom.getAddress();
+	rom.absolute(JMP_ABS, loop);
+	uint16_t nmi = rom.getAddress();
+	rom.implied(RTI);
+	rom.setVectors(nmi, reset, 0);
+
+	// Copy the program to every page that can be switched to $c000, and
+	// number each page. UxROM fixes the last page there, and the 32kb
+	// mappers switch in odd pages.
+	for( int page = 0; page < 8; page++ )
+	{
+		uint8_t* data = rom.getPrg() + page * 0x4000;
+		bool switchable = (mapper == 3) || (mapper != 2 && (page % 2) == 1);
+		if( switchable && page != 7 )
+		{
+			std::copy(program, program + 0x4000, data);
+		}
+		data[0] = page;
+	}
+
+	for( int page = 0; page < chrPages; page++ )
+	{
+		rom.getChr()[page * 0x2000] = 0xc0 + page;
+	}
+
+	TestCase test;
+	test.name = name;
+	test.image = rom.build();
+	expect(test, 0x00, banks);
+	test.frameChecksum = 0x04f6f003; // Rendering is never enabled
+	return test;
+}
+
+/**
+ * AxROM single screen mirroring, which starts out on the lower page whatever
+ * the header says. Nametable bytes are written through one table and read
+ * back through another. Then a static screen is shown while the NMI handler
+ * writes the same latch value every frame, which must not count as a change.
+ */
+static TestCase buildAxROMMirroring()
+{
+	ROMBuilder rom(7, 2, 0, 1);
+	rom.setOrigin(0x4100, 0xc100);
+	uint16_t reset = rom.getAddress();
+	emitReset(rom);
+	rom.absolute(LDA_ABS, 0x2002);
+
+	// Before any latch write, $2400 is the same page as $2000
+	emitPPUAddress(rom, 0x2400);
+	rom.store(0x2007, 0x11);
+	emitPPUAddress(rom, 0x2000);
+	rom.absolute(LDA_ABS, 0x2007);
+	rom.zeroPage(STA_ZP, 0x00);
+
+	// The upper page is separate
+	rom.store(0x8000, 0x10);
+	emitPPUAddress(rom, 0x2000);
+	rom.absolute(LDA_ABS, 0x2007);
+	rom.zeroPage(STA_ZP, 0x01);
+	emitPPUAddress(rom, 0x2c00);
+	rom.store(0x2007, 0x22);
+	emitPPUAddress(rom, 0x2400);
+	rom.absolute(LDA_ABS, 0x2007);
+	rom.zeroPage(STA_ZP, 0x02);
+
+	// And switching back shows the lower page again
+	rom.store(0x8000, 0x00);
+	emitPPUAddress(rom, 0x2800);
+	rom.absolute(LDA_ABS, 0x2007);
+	rom.zeroPage(STA_ZP, 0x03);
+
+	emitPalette(rom, { 0x16 });
+	rom.store(0x2005, 0x00);
+	rom.absolute(STA_ABS, 0x2005);
+	rom.store(0x2001, 0x0a);
+	rom.store(0x2000, 0x80);
+	uint16_t loop = rom.getAddress();
+	rom.absolute(JMP_ABS, loop);
+
+	uint16_t nmi = rom.getAddress();
+	rom.store(0x8000, 0x00);
+	rom.store(0x2005, 0x00);
+	rom.absolute(STA_ABS, 0x2005);
+	rom.implied(RTI);
+	rom.setVectors(nmi, reset, 0);
+
+	TestCase test;
+	test.name = "AxROM mirroring";
+	test.image = rom.build();
+	expect(test, 0x00, { 0x11, 0x00, 0x22, 0x11 });
+	test.frameChecksum = 0xaa470884;
+	test.staticFrames = true;
+	return test;
+}
+
+/**
+ * Emit the setup shared by the scrolling tests: a palette, two nametables
+ * of vertical bars, and attributes for the first row of the first.
+ */
+static void emitScrollSetup( ROMBuilder& rom )
+{
+	emitReset(rom);
+	rom.store(0x2001, 0x00);
+	emitPalette(rom, { 0x0f, 0x30, 0x16, 0x12, 0x0f, 0x2a, 0x27, 0x11 });
+
+	// Tiles 0-15 across the first nametable, and 16-31 across the second
+	emitPPUAddress(rom, 0x2000);
+	rom.immediate(LDY_IMM, 0x00);
+	uint16_t page = rom.getAddress();
+	rom.immediate(LDX_IMM, 0x00);
+	uint16_t tile = rom.getAddress();
+	rom.implied(TXA);
+	rom.immediate(AND_IMM, 0x0f);
+	rom.immediate(CPY_IMM, 0x04);
+	rom.branch(BCC, rom.getAddress() + 4);
+	rom.immediate(ORA_IMM, 0x10);
+	rom.absolute(STA_ABS, 0x2007);
+	rom.implied(INX);
+	rom.branch(BNE, tile);
+	rom.implied(INY);
+	rom.immediate(CPY_IMM, 0x08);
+	rom.branch(BNE, page);
+
+	emitPPUAddress(rom, 0x23c0);
+	for( int i = 0; i < 8; i++ )
+	{
+		rom.store(0x2007, 0x55);
+	}
+}
+
+/**
+ * Fill CHR ROM with bars of different heights for the scrolling tests.
+ */
+static void fillScrollCHR( ROMBuilder& rom )
+{
+	for( int tile = 0; tile < 32; tile++ )
+	{
+		for( int row = 0; row < 8; row++ )
+		{
+			uint8_t bar = (row <= tile % 8) ? 0xff : 0x81;
+			uint8_t* data = rom.getChr() + tile * 16;
+			data[row] = (tile < 16 || (tile % 2) == 1) ? bar : 0;
+			if( tile < 16 )
+			{
+				data[row + 8] = ((tile / 8) % 2) ? 0xf0 : 0;
+			}
+			else
+			{
+				data[row + 8] = bar;
+			}
+		}
+	}
+}
+
+/**
+ * Horizontal scrolling by one pixel each frame.
+ */
+static TestCase buildScroll()
+{
+	ROMBuilder rom(0, 1, 1, 1);
+	rom.setOrigin(0, 0xc000);
+	emitScrollSetup(rom);
+	rom.store(0x2001, 0x1e);
+	rom.store(0x2000, 0x80);
+	uint16_t loop = rom.getAddress();
+	rom.absolute(JMP_ABS, loop);
+
+	uint16_t nmi = rom.getAddress();
+	rom.zeroPage(INC_ZP, 0x10);
+	rom.zeroPage(LDA_ZP, 0x10);
+	rom.absolute(STA_ABS, 0x2005);
+	rom.store(0x2005, 0x00);
+	rom.store(0x2000, 0x80);
+	rom.implied(RTI);
+	rom.setVectors(nmi, 0xc000, 0);
+	fillScrollCHR(rom);
+
+	TestCase test;
+	test.name = "scroll";
+	test.image = rom.build();
+	expect(test, 0x10, { FRAME_COUNT - 2 });
+	test.frameChecksum = 0xbafac9eb;
+	return test;
+}
+
+/**
+ * A split screen timed by sprite 0 hit, with a row of sprites above it.
+ * The scroll position is changed in the middle of a scanline, which only the
+ * dot renderer shows there.
+ */
+static TestCase buildSpriteZero()
+{
+	ROMBuilder rom(0, 1, 1, 1);
+	rom.setOrigin(0, 0xc000);
+	emitScrollSetup(rom);
+
+	// Sprite 0 in the middle of the screen, ten sprites in a row above it,
+	// and the rest hidden below the screen
+	rom.store(0x2003, 0x00);
+	for( int sprite = 0; sprite < 64; sprite++ )
+	{
+		int y = 0xff, tile = 0, attributes = 0, x = 0;
+		if( sprite == 0 )
+		{
+			y = 119;
+			tile = 1;
+			x = 100;
+		}
+		else if( sprite <= 10 )
+		{
+			y = 60;
+			tile = 3;
+			attributes = 1;
+			x = sprite * 20;
+		}
+		for( int value : { y, tile, attributes, x } )
+		{
+			rom.store(0x2004, value);
+		}
+	}
+
+	emitPPUAddress(rom, 0x3f10);
+	for( int color : { 0x0f, 0x21, 0x22, 0x23, 0x0f, 0x14, 0x15, 0x16 } )
+	{
+		rom.store(0x2007, color);
+	}
+	rom.store(0x2006, 0x00);
+	rom.absolute(STA_ABS, 0x2006);
+	rom.store(0x2001, 0x1e);
+	rom.store(0x2000, 0x80);
+
+	// Wait for sprite 0 hit to clear and then be set, and scroll the rest
+	// of the screen
+	uint16_t waitClear = rom.getAddress();
+	rom.absolute(LDA_ABS, 0x2002);
+	rom.immediate(AND_IMM, 0x40);
+	rom.branch(BNE, waitClear);
+	uint16_t waitHit = rom.getAddress();
+	rom.absolute(LDA_ABS, 0x2002);
+	rom.immediate(AND_IMM, 0x40);
+	rom.branch(BEQ, waitHit);
+	rom.zeroPage(LDA_ZP, 0x10);
+	rom.implied(ASL);
+	rom.absolute(STA_ABS, 0x2005);
+	rom.absolute(STA_ABS, 0x2005);
+	rom.absolute(JMP_ABS, waitClear);
+
+	uint16_t nmi = rom.getAddress();
+	rom.zeroPage(INC_ZP, 0x10);
+	rom.store(0x2005, 0x00);
+	rom.absolute(STA_ABS, 0x2005);
+	rom.store(0x2000, 0x80);
+	rom.implied(RTI);
+	rom.setVectors(nmi, 0xc000, 0);
+	fillScrollCHR(rom);
+
+	TestCase test;
+	test.name = "sprite 0 hit";
+	test.image = rom.build();
+	expect(test, 0x10, { FRAME_COUNT - 2 });
+	test.exactScanlines = false;
+	test.frameChecksum = 0x672dba4c;
+	return test;
+}
+
+/**
+ * Loops that poll PPUSTATUS, which are skipped up to the next change of
+ * the flags. A wait for sprite 0 hit with BIT and BVC is timed by counting
+ * the iterations of a loop that isn't skipped until vblank, and a wait
+ * for vblank with LDA and BPL by counting them until the flags are cleared.
+ */
+static TestCase buildStatusPolling()
+{
+	ROMBuilder rom(0, 1, 1, 1);
+	rom.setOrigin(0, 0xc000);
+	emitScrollSetup(rom);
+
+	// Sprite 0 in the middle of the screen, ten sprites in a row above it
+	// to set the overflow flag, and the rest hidden below the screen
+	rom.store(0x2003, 0x00);
+	for( int sprite = 0; sprite < 64; sprite++ )
+	{
+		int y = (sprite == 0) ? 119 : (sprite <= 10) ? 60 : 0xff;
+		for( int value : { y, 1, 0, sprite * 20 + 20 } )
+		{
+			rom.store(0x2004, value);
+		}
+	}
+	rom.store(0x2001, 0x1e);
+	rom.store(0x2000, 0x00);
+
+	// Wait for sprite 0 hit, split the screen, and count up to vblank
+	uint16_t waitHit = rom.getAddress();
+	rom.absolute(BIT_ABS, 0x2002);
+	rom.branch(BVC, waitHit);
+	rom.store(0x2005, 0x40);
+	rom.absolute(STA_ABS, 0x2005);
+	rom.immediate(LDY_IMM, 0x00);
+	uint16_t countToVblank = rom.getAddress();
+	rom.implied(INY);
+	rom.absolute(LDA_ABS, 0x2002);
+	rom.branch(BPL, countToVblank);
+	rom.store(0x2005, 0x00);
+	rom.absolute(STA_ABS, 0x2005);
+
+	// Wait for the next vblank, and count up to the pre-render scanline
+	uint16_t waitVblank = rom.getAddress();
+	rom.absolute(LDA_ABS, 0x2002);
+	rom.branch(BPL, waitVblank);
+	rom.immediate(LDX_IMM, 0x00);
+	uint16_t countToClear = rom.getAddress();
+	rom.implied(INX);
+	rom.absolute(BIT_ABS, 0x2002);
+	rom.branch(BVS, countToClear);
+	rom.implied(TXA);
+	rom.zeroPage(STA_ZP, 0x12);
+	rom.implied(TYA);
+	rom.zeroPage(STA_ZP, 0x11);
+	rom.zeroPage(INC_ZP, 0x10);
+	rom.absolute(JMP_ABS, waitHit);
+	rom.setVectors(0, 0xc000, 0);
+	fillScrollCHR(rom);
+
+	TestCase test;
+	test.name = "PPUSTATUS polling";
+	test.image = rom.build();
+	expect(test, 0x10, { 0x1d, 0xb5, 0x1c });
+	test.exactScanlines = false;
+	test.frameChecksum = 0xb29328c4;
+	return test;
+}
+
+//*********************************************************************
+// Running and checking
+//*********************************************************************
+
+/**
+ * Update a CRC-32 checksum with some data.
+ */
+static uint32_t crc32( uint32_t crc, const uint8_t* data, size_t size )
+{
+	static uint32_t table[256];
+	if( table[1] == 0 )
+	{
+		for( uint32_t i = 0; i < 256; i++ )
+		{
+			uint32_t value = i;
+			for( int bit = 0; bit < 8; bit++ )
+			{
+				value = (value & 1) ? (value >> 1) ^ 0xedb88320 : (value >> 1);
+			}
+			table[i] = value;
+		}
+	}
+
+	crc = ~crc;
+	for( size_t i = 0; i < size; i++ )
+	{
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+/**
+ * The result of running a ROM with one configuration.
+ */
+struct RunResult
+{
+	uint32_t ramChecksum;   /**< Checksum of RAM at each checkpoint. */
+	uint32_t frameChecksum; /**< Checksum of the framebuffer at each checkpoint. */
+	uint8_t ram[0x800];     /**< RAM at the end. */
+	bool frameChanged;      /**< True if the last frame was reported to differ from the one before. */
+};
+
+/**
+ * Run a test ROM with one configuration.
+ */
+static void run( const TestCase& test, const Configuration& configuration, RunResult& result )
+{
+	// The NES uses the ROM data in place
+	std::vector<uint8_t> romData(test.image);
+
+	// Keep the mapper information printed on startup out of the results
+	std::streambuf* output = std::cout.rdbuf(nullptr);
+	NES* nes = new NES(romData.data());
+	std::cout.rdbuf(output);
+
+	nes->getCPU().setExecutionMode(configuration.executionMode);
+	nes->getPPU().setRenderMode(configuration.renderMode);
+	nes->getPPU().setBackgroundCacheEnabled(configuration.backgroundCache);
+
+	result.ramChecksum = 0;
+	result.frameChecksum = 0;
+	for( int frame = 1; frame <= test.frameCount; frame++ )
+	{
+		nes->stepFrame((frame % configuration.renderInterval) == 0);
+		if( (frame % CHECKSUM_INTERVAL) == 0 )
+		{
+			result.ramChecksum = crc32(result.ramChecksum, nes->getMemory().getRAM(), 0x800);
+			result.frameChecksum = crc32(result.frameChecksum, (const uint8_t*)nes->getPPU().getFrameBuffer(), 256 * 240 * sizeof(uint32_t));
+		}
+	}
+	std::copy(nes->getMemory().getRAM(), nes->getMemory().getRAM() + 0x800, result.ram);
+	result.frameChanged = nes->getPPU().isFrameChanged();
+
+	delete nes;
+}
+
+/**
+ * Run a test with every configuration and report any differences.
+ *
+ * @return the number of failed checks.
+ */
+static int check( const TestCase& test )
+{
+	RunResult results[CONFIGURATION_COUNT];
+	int dotReference = -1;
+	int failures = 0;
+	for( int i = 0; i < CONFIGURATION_COUNT; i++ )
+	{
+		const Configuration& configuration = configurations[i];
+		RunResult& result = results[i];
+		run(test, configuration, result);
+
+		// Mid-scanline effects, and PPUSTATUS flags set in the middle of a
+		// scanline, are only exact with the dot renderer
+		int reference = 0;
+		if( configuration.renderMode == RENDER_DOT && !test.exactScanlines )
+		{
+			if( dotReference < 0 )
+			{
+				dotReference = i;
+			}
+			reference = dotReference;
+		}
+		if( result.ramChecksum != results[reference].ramChecksum )
+		{
+			printf("%s: %s: RAM differs from %s\n", test.name.c_str(), configuration.name, configurations[reference].name);
+			failures++;
+		}
+		if( result.frameChecksum != results[reference].frameChecksum )
+		{
+			printf("%s: %s: framebuffer differs from %s\n", test.name.c_str(), configuration.name, configurations[reference].name);
+			failures++;
+		}
+
+		if( test.staticFrames && configuration.renderMode == RENDER_SCANLINE && result.frameChanged )
+		{
+			printf("%s: %s: unchanged frame was reported as changed\n", test.name.c_str(), configuration.name);
+			failures++;
+		}
+
+		for( const std::pair<uint16_t, uint8_t>& expected : test.expected )
+		{
+			uint8_t value = result.ram[expected.first];
+			if( value != expected.second )
+			{
+				printf("%s: %s: $%02X is %02X, expected %02X\n", test.name.c_str(), configuration.name, expected.first, value, expected.second);
+				failures++;
+			}
+		}
+	}
+
+	if( test.frameChecksum != 0 && results[0].frameChecksum != test.frameChecksum )
+	{
+		printf("%s: %s: framebuffer checksum is %08X, expected %08X\n", test.name.c_str(), configurations[0].name, results[0].frameChecksum, test.frameChecksum);
+		failures++;
+	}
+
+	printf("%s: %s (framebuffer %08X)\n", test.name.c_str(), failures == 0 ? "ok" : "FAILED", results[0].frameChecksum);
+	return failures;
+}
+
+/**
+ * Load a ROM file as a test without any expected values.
+ */
+static bool loadTest( const char* filename, TestCase& test )
+{
+	FILE* file = fopen(filename, "rb");
+	if( file == NULL )
+	{
+		return false;
+	}
+
+	fseek(file, 0L, SEEK_END);
+	size_t fileSize = ftell(file);
+	fseek(file, 0L, SEEK_SET);
+
+	test.name = filename;
+	test.image.resize(fileSize);
+	size_t readSize = fread(test.image.data(), sizeof(uint8_t), fileSize, file);
+	fclose(file);
+
+	test.frameCount = ROM_FILE_FRAME_COUNT;
+	test.exactScanlines = false;
+	return readSize == fileSize;
+}
+
+int main( int argc, char** argv )
+{
+	std::vector<TestCase> tests;
+	tests.push_back(buildMMC1(true));
+	tests.push_back(buildMMC1(false));
+	tests.push_back(buildMMC3(false));
+	tests.push_back(buildMMC3(true));
+	tests.push_back(buildDiscrete("UxROM", 2, 0, { 0x00, 0x03, 0x05 },
+		{ 0x00, 0x07, 0x00, 0x03, 0x07, 0x00, 0x05, 0x07, 0x00, 0x01, 0x07, 0x00 }));
+	tests.push_back(buildDiscrete("CNROM", 3, 4, { 0x00, 0x01, 0x03 },
+		{ 0x00, 0x07, 0xc0, 0x00, 0x07, 0xc1, 0x00, 0x07, 0xc3, 0x00, 0x07, 0xc1 }));
+	tests.push_back(buildDiscrete("AxROM", 7, 0, { 0x00, 0x01, 0x03, 0x12 },
+		{ 0x00, 0x01, 0x00, 0x02, 0x03, 0x00, 0x06, 0x07, 0x00, 0x04, 0x05, 0x00, 0x06, 0x07, 0x00 }));
+	tests.push_back(buildAxROMMirroring());
+	tests.push_back(buildDiscrete("Color Dreams", 11, 4, { 0x00, 0x11, 0x32 },
+		{ 0x00, 0x01, 0xc0, 0x02, 0x03, 0xc1, 0x04, 0x05, 0xc3, 0x02, 0x03, 0xc0 }));
+	tests.push_back(buildDiscrete("GxROM", 66, 4, { 0x00, 0x11, 0x23 },
+		{ 0x00, 0x01, 0xc0, 0x02, 0x03, 0xc1, 0x04, 0x05, 0xc3, 0x00, 0x01, 0xc1 }));
+	tests.push_back(buildScroll());
+	tests.push_back(buildSpriteZero());
+	tests.push_back(buildStatusPolling());
+
+	for( int i = 1; i < argc; i++ )
+	{
+		TestCase test;
+		if( !loadTest(argv[i], test) )
+		{
+			std::cout << "Error: Failed to load ROM \"" << argv[i] << "\"\n";
+			return -1;
+		}
+		tests.push_back(test);
+	}
+
+	int failures = 0;
+	for( const TestCase& test : tests )
+	{
+		failures += check(test);
+	}
+
+	if( failures > 0 )
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+
+	printf("All checks passed\n");
+	return 0;
+}